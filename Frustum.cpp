@@ -0,0 +1,215 @@
+#include "Frustum.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GPS_CULL_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace gps {
+
+	static_assert(sizeof(BoundingSphere) == 4 * sizeof(float), "CullBounds loads spheres as four floats");
+
+	static CullingStats cullingStats = { 0, 0, 0 };
+
+	Frustum Frustum::FromMatrix(const glm::mat4& viewProjection)
+	{
+		// rows of the matrix - glm is column major
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		Frustum frustum;
+		frustum.planeCount = 6;
+		frustum.planes[0] = rows[3] + rows[0];
+		frustum.planes[1] = rows[3] - rows[0];
+		frustum.planes[2] = rows[3] + rows[1];
+		frustum.planes[3] = rows[3] - rows[1];
+		frustum.planes[4] = rows[3] + rows[2];
+		frustum.planes[5] = rows[3] - rows[2];
+
+		for (int i = 0; i < 6; i++) {
+			float length = glm::length(glm::vec3(frustum.planes[i]));
+			if (length > 0.0f)
+				frustum.planes[i] /= length;
+		}
+		return frustum;
+	}
+
+	Frustum Frustum::Everything()
+	{
+		// no plane to be outside of
+		Frustum frustum;
+		frustum.planeCount = 0;
+		return frustum;
+	}
+
+	Frustum Frustum::ShadowCasters(const Frustum& light, const Frustum& receivers, const glm::vec3& towardLight, float maxDistance)
+	{
+		Frustum frustum = light;
+		glm::vec3 direction = glm::normalize(towardLight);
+		for (int i = 0; i < receivers.planeCount && frustum.planeCount < FRUSTUM_MAX_PLANES; i++) {
+			// the shadow of p lands on p - t * direction with t up to maxDistance; planes facing
+			// away from the light move out by as much as that can cross them
+			glm::vec4 plane = receivers.planes[i];
+			float facing = glm::dot(glm::vec3(plane), direction);
+			if (facing < 0.0f)
+				plane.w -= facing * maxDistance;
+			frustum.planes[frustum.planeCount++] = plane;
+		}
+		return frustum;
+	}
+
+	bool Frustum::Intersects(const BoundingSphere& sphere) const
+	{
+		for (int i = 0; i < planeCount; i++) {
+			if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius)
+				return false;
+		}
+		return true;
+	}
+
+	bool Frustum::Intersects(const BoundingBox& box) const
+	{
+		glm::vec3 center = (box.minimum + box.maximum) * 0.5f;
+		glm::vec3 extent = (box.maximum - box.minimum) * 0.5f;
+		for (int i = 0; i < planeCount; i++) {
+			glm::vec3 normal = glm::vec3(planes[i]);
+			// projected radius of the box on the plane normal
+			float radius = glm::dot(glm::abs(normal), extent);
+			if (glm::dot(normal, center) + planes[i].w < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	FrustumTest Frustum::Classify(const BoundingBox& box) const
+	{
+		glm::vec3 center = (box.minimum + box.maximum) * 0.5f;
+		glm::vec3 extent = (box.maximum - box.minimum) * 0.5f;
+		FrustumTest result = FRUSTUM_INSIDE;
+		for (int i = 0; i < planeCount; i++) {
+			glm::vec3 normal = glm::vec3(planes[i]);
+			float radius = glm::dot(glm::abs(normal), extent);
+			float distance = glm::dot(normal, center) + planes[i].w;
+			if (distance < -radius)
+				return FRUSTUM_OUTSIDE;
+			if (distance < radius)
+				result = FRUSTUM_INTERSECTS;
+		}
+		return result;
+	}
+
+	Frustum Frustum::Transformed(const glm::mat4& transform) const
+	{
+		// dot(plane, M * p) == dot(transpose(M) * plane, p)
+		glm::mat4 transposed = glm::transpose(transform);
+		Frustum frustum;
+		frustum.planeCount = planeCount;
+		for (int i = 0; i < planeCount; i++) {
+			frustum.planes[i] = transposed * planes[i];
+			float length = glm::length(glm::vec3(frustum.planes[i]));
+			if (length > 0.0f)
+				frustum.planes[i] /= length;
+		}
+		return frustum;
+	}
+
+	BoundingBox TransformBox(const BoundingBox& box, const glm::mat4& transform)
+	{
+		glm::vec3 center = glm::vec3(transform * glm::vec4((box.minimum + box.maximum) * 0.5f, 1.0f));
+		glm::vec3 extent = (box.maximum - box.minimum) * 0.5f;
+
+		// the new half extent is |M| * extent, with M the upper 3x3 of the transform
+		glm::mat3 absolute = glm::mat3(transform);
+		for (int column = 0; column < 3; column++)
+			absolute[column] = glm::abs(absolute[column]);
+		glm::vec3 newExtent = absolute * extent;
+
+		BoundingBox result;
+		result.minimum = center - newExtent;
+		result.maximum = center + newExtent;
+		return result;
+	}
+
+	BoundingSphere TransformSphere(const BoundingSphere& sphere, const glm::mat4& transform)
+	{
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+		BoundingSphere result;
+		result.center = glm::vec3(transform * glm::vec4(sphere.center, 1.0f));
+		result.radius = sphere.radius * scale;
+		return result;
+	}
+
+	void CullBounds(const Frustum& frustum, const BoundingSphere* spheres, const BoundingBox* boxes, size_t count, unsigned char* visible)
+	{
+		size_t i = 0;
+
+#ifdef GPS_CULL_SSE
+		__m128 planeX[FRUSTUM_MAX_PLANES], planeY[FRUSTUM_MAX_PLANES], planeZ[FRUSTUM_MAX_PLANES], planeW[FRUSTUM_MAX_PLANES];
+		for (int p = 0; p < frustum.planeCount; p++) {
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+		}
+		__m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4) {
+			// four spheres, transposed to x/y/z/radius registers
+			__m128 x = _mm_loadu_ps(&spheres[i + 0].center.x);
+			__m128 y = _mm_loadu_ps(&spheres[i + 1].center.x);
+			__m128 z = _mm_loadu_ps(&spheres[i + 2].center.x);
+			__m128 radius = _mm_loadu_ps(&spheres[i + 3].center.x);
+			_MM_TRANSPOSE4_PS(x, y, z, radius);
+			__m128 negativeRadius = _mm_sub_ps(zero, radius);
+
+			__m128 outside = zero;
+			for (int p = 0; p < frustum.planeCount; p++) {
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+					_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+			}
+
+			int outsideMask = _mm_movemask_ps(outside);
+			for (int lane = 0; lane < 4; lane++)
+				visible[i + lane] = (outsideMask & (1 << lane)) ? 0 : 1;
+		}
+#endif
+
+		for (; i < count; i++)
+			visible[i] = frustum.Intersects(spheres[i]) ? 1 : 0;
+
+		// the sphere test is loose around long thin objects, the box catches the rest
+		size_t culled = 0;
+		for (i = 0; i < count; i++) {
+			if (visible[i] && boxes && !frustum.Intersects(boxes[i]))
+				visible[i] = 0;
+			culled += visible[i] ? 0 : 1;
+		}
+
+		RecordCulling(count, culled, 0);
+	}
+
+	void RecordCulling(size_t tested, size_t culled, size_t nodesVisited)
+	{
+		cullingStats.tested += tested;
+		cullingStats.culled += culled;
+		cullingStats.nodesVisited += nodesVisited;
+	}
+
+	const CullingStats& GetCullingStats()
+	{
+		return cullingStats;
+	}
+
+	void ResetCullingStats()
+	{
+		cullingStats.tested = 0;
+		cullingStats.culled = 0;
+		cullingStats.nodesVisited = 0;
+	}
+}
@@ -0,0 +1,88 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+struct BoundingBox
+{
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+};
+
+// 16 bytes, so an array of them can be loaded straight into SSE registers
+struct BoundingSphere
+{
+    glm::vec3 center;
+    float radius;
+};
+
+enum FrustumTest
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+// Most planes a Frustum can hold - a view frustum and a light volume together
+const int FRUSTUM_MAX_PLANES = 12;
+
+// Convex volume bounded by planes with the normal (xyz) pointing inside. FromMatrix gives
+// six: left, right, bottom, top, near, far
+struct Frustum
+{
+    glm::vec4 planes[FRUSTUM_MAX_PLANES];
+    int planeCount;
+
+    // Extracts the normalized planes of a projection * view matrix (Gribb/Hartmann)
+    static Frustum FromMatrix(const glm::mat4& viewProjection);
+
+    // Frustum that contains everything, for passes that do not cull
+    static Frustum Everything();
+
+    // Volume of the objects that can throw a shadow onto the receivers: inside the light
+    // volume, and within maxDistance toward the light of the receivers
+    static Frustum ShadowCasters(const Frustum& light, const Frustum& receivers, const glm::vec3& towardLight, float maxDistance);
+
+    bool Intersects(const BoundingSphere& sphere) const;
+    bool Intersects(const BoundingBox& box) const;
+
+    // Like Intersects, but also tells apart boxes that are completely inside
+    FrustumTest Classify(const BoundingBox& box) const;
+
+    // The same frustum in the space that transform maps to world space, so objects can
+    // be tested with their model space bounds
+    Frustum Transformed(const glm::mat4& transform) const;
+};
+
+// Axis aligned box around a transformed box
+BoundingBox TransformBox(const BoundingBox& box, const glm::mat4& transform);
+
+// Sphere around a transformed sphere, scaled by the largest axis scale
+BoundingSphere TransformSphere(const BoundingSphere& sphere, const glm::mat4& transform);
+
+// Sets visible[i] for count objects: spheres are tested four at a time with SSE, and the
+// ones that pass are refined with their box. Updates the culling statistics.
+void CullBounds(const Frustum& frustum, const BoundingSphere* spheres, const BoundingBox* boxes, size_t count, unsigned char* visible);
+
+struct CullingStats
+{
+    size_t tested;
+    size_t culled;
+    // hierarchy nodes visited by SceneBvh queries
+    size_t nodesVisited;
+};
+
+// Objects tested and rejected by CullBounds and SceneBvh since the last reset
+const CullingStats& GetCullingStats();
+
+void RecordCulling(size_t tested, size_t culled, size_t nodesVisited);
+
+void ResetCullingStats();
+
+}
+
+#endif /* Frustum_hpp */
@@ -0,0 +1,56 @@
+#include "GpuTimer.hpp"
+
+namespace gps {
+
+	GpuTimer::GpuTimer()
+	{
+		queries[0] = 0;
+		queries[1] = 0;
+		issued[0] = false;
+		issued[1] = false;
+		current = 0;
+		milliseconds = 0.0;
+	}
+
+	GpuTimer::~GpuTimer()
+	{
+		// deleting the name 0 is silently ignored by GL
+		glDeleteQueries(2, queries);
+	}
+
+	void GpuTimer::Begin()
+	{
+		if (!queries[0])
+			glGenQueries(2, queries);
+
+		// take the newest result that has arrived - the older slot is about to be reused
+		current ^= 1;
+		int slots[2] = { current, current ^ 1 };
+		for (int i = 0; i < 2; i++) {
+			int slot = slots[i];
+			if (!issued[slot])
+				continue;
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+			milliseconds = nanoseconds / 1.0e6;
+			issued[slot] = false;
+		}
+
+		glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+	}
+
+	void GpuTimer::End()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		issued[current] = true;
+	}
+
+	double GpuTimer::GetMilliseconds() const
+	{
+		return milliseconds;
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+// GPU time of a span of commands, from GL_TIME_ELAPSED queries. Like OcclusionCuller it
+// keeps two queries and reads the one from the frame before, so it never waits on the GPU.
+class GpuTimer
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    // Spans must not nest - GL has one time elapsed query active at a time
+    void Begin();
+    void End();
+
+    // Milliseconds of the last span whose result has arrived, 0 before the first one
+    double GetMilliseconds() const;
+
+private:
+    GLuint queries[2];
+    bool issued[2];
+    int current;
+    double milliseconds;
+};
+
+}
+
+#endif /* GpuTimer_hpp */
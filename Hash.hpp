@@ -0,0 +1,39 @@
+#ifndef Hash_hpp
+#define Hash_hpp
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace gps {
+
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+// 64-bit FNV-1a; pass the previous result as `hash` to hash data in pieces
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// Hashes the whole content of a file, returns false if it cannot be read
+inline bool HashFile(std::string fileName, uint64_t& hash)
+{
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+
+    hash = HASH_SEED;
+    char buffer[64 * 1024];
+    while (file) {
+        file.read(buffer, sizeof(buffer));
+        hash = HashBytes(buffer, (size_t)file.gcount(), hash);
+    }
+    return true;
+}
+
+}
+
+#endif /* Hash_hpp */
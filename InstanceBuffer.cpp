@@ -0,0 +1,59 @@
+#include "InstanceBuffer.hpp"
+
+namespace gps {
+
+	InstanceBuffer::InstanceBuffer()
+	{
+		buffer = 0;
+		count = 0;
+		capacity = 0;
+	}
+
+	InstanceBuffer::~InstanceBuffer()
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+
+	void InstanceBuffer::Update(const std::vector<glm::mat4>& transforms)
+	{
+		if (!buffer)
+			glGenBuffers(1, &buffer);
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (transforms.size() > capacity) {
+			capacity = transforms.size();
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), transforms.data(), GL_DYNAMIC_DRAW);
+		}
+		else if (!transforms.empty()) {
+			// orphan the old storage so a draw still reading it does not stall the upload
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		count = (GLsizei)transforms.size();
+	}
+
+	GLuint InstanceBuffer::getBuffer() const
+	{
+		return buffer;
+	}
+
+	GLsizei InstanceBuffer::getCount() const
+	{
+		return count;
+	}
+
+	void InstanceBuffer::bindAttributes() const
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		// a mat4 attribute takes four consecutive locations, one per column
+		for (GLuint column = 0; column < 4; column++) {
+			GLuint location = INSTANCE_MATRIX_LOCATION + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(location, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef InstanceBuffer_hpp
+#define InstanceBuffer_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+// Attribute locations of the per-instance model matrix, one column each
+const GLuint INSTANCE_MATRIX_LOCATION = 3;
+
+// GL buffer of per-instance model matrices, read by the *Instanced.vert shaders. The
+// shaders transform normals by the matrix too, so it may only rotate, translate and scale
+// uniformly.
+class InstanceBuffer
+{
+public:
+    InstanceBuffer();
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // Replaces the transforms; the storage only grows, so updating every frame is cheap
+    void Update(const std::vector<glm::mat4>& transforms);
+
+    GLuint getBuffer() const;
+    GLsizei getCount() const;
+
+    // Points the instance matrix attributes of the bound VAO at this buffer
+    void bindAttributes() const;
+
+private:
+    GLuint buffer;
+    GLsizei count;
+    size_t capacity;
+};
+
+}
+
+#endif /* InstanceBuffer_hpp */
@@ -1,35 +1,224 @@
 #include "Mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+
 namespace gps {
 
+	static const UniformId POSITION_OFFSET_UNIFORM = Shader::uniformId("positionOffset");
+	static const UniformId POSITION_SCALE_UNIFORM = Shader::uniformId("positionScale");
+
 	/* Mesh Constructor */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
 
 		this->setupMesh();
 	}
 
+	Mesh::Mesh(const MeshGeometry& geometry, std::vector<Texture> textures, bool keepCpuData)
+	{
+		this->textures = std::move(textures);
+		if (keepCpuData) {
+			UnpackMesh(geometry, this->vertices, this->indices);
+		}
+
+		this->setupMesh(geometry);
+	}
+
+	Mesh::~Mesh()
+	{
+		this->deleteBuffers();
+	}
+
+	Mesh::Mesh(Mesh&& other) noexcept
+	{
+		this->vertices = std::move(other.vertices);
+		this->indices = std::move(other.indices);
+		this->textures = std::move(other.textures);
+		this->buffers = other.buffers;
+		this->indexCount = other.indexCount;
+		this->indexType = other.indexType;
+		this->positionOffset = other.positionOffset;
+		this->positionScale = other.positionScale;
+		this->lods = std::move(other.lods);
+		this->instanceBuffer = other.instanceBuffer;
+		this->boundingBox = other.boundingBox;
+		this->boundingSphere = other.boundingSphere;
+		this->castsShadows = other.castsShadows;
+
+		// the moved-from mesh no longer owns the GL objects
+		other.buffers.VAO = 0;
+		other.buffers.VBO = 0;
+		other.buffers.EBO = 0;
+		other.indexCount = 0;
+	}
+
+	Mesh& Mesh::operator=(Mesh&& other) noexcept
+	{
+		if (this != &other) {
+			this->deleteBuffers();
+
+			this->vertices = std::move(other.vertices);
+			this->indices = std::move(other.indices);
+			this->textures = std::move(other.textures);
+			this->buffers = other.buffers;
+			this->indexCount = other.indexCount;
+			this->indexType = other.indexType;
+			this->positionOffset = other.positionOffset;
+			this->positionScale = other.positionScale;
+			this->lods = std::move(other.lods);
+			this->instanceBuffer = other.instanceBuffer;
+			this->boundingBox = other.boundingBox;
+			this->boundingSphere = other.boundingSphere;
+			this->castsShadows = other.castsShadows;
+
+			other.buffers.VAO = 0;
+			other.buffers.VBO = 0;
+			other.buffers.EBO = 0;
+			other.indexCount = 0;
+		}
+		return *this;
+	}
+
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	void Mesh::releaseCpuData() {
+		// swap with empty vectors, clear() would keep the capacity
+		std::vector<Vertex>().swap(this->vertices);
+		std::vector<GLuint>().swap(this->indices);
+	}
+
+	void Mesh::deleteBuffers() {
+		// deleting the name 0 is silently ignored by GL
+		glDeleteBuffers(1, &this->buffers.VBO);
+		glDeleteBuffers(1, &this->buffers.EBO);
+		glDeleteVertexArrays(1, &this->buffers.VAO);
+		this->buffers.VAO = 0;
+		this->buffers.VBO = 0;
+		this->buffers.EBO = 0;
+	}
+
+	int Mesh::getLodCount() const {
+		return (int)this->lods.size();
+	}
+
+	const std::vector<MeshLod>& Mesh::getLods() const {
+		return this->lods;
+	}
+
+	const BoundingBox& Mesh::getBoundingBox() const {
+		return this->boundingBox;
+	}
+
+	const BoundingSphere& Mesh::getBoundingSphere() const {
+		return this->boundingSphere;
+	}
+
+	bool Mesh::getCastsShadows() const {
+		return this->castsShadows;
+	}
+
+	void Mesh::setCastsShadows(bool castsShadows) {
+		this->castsShadows = castsShadows;
+	}
+
+	int SelectLod(const LodView& view, const glm::mat4& model, glm::vec3 center, float radius, int lodCount)
+	{
+		if (lodCount < 2)
+			return 0;
+
+		// bounding sphere taken to world space
+		glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		float worldRadius = radius * scale;
+
+		float pixels;
+		if (view.orthographic) {
+			pixels = worldRadius * view.pixelsPerUnit;
+		}
+		else {
+			float distance = glm::length(worldCenter - view.eyePosition);
+			// the camera is inside the sphere
+			if (distance <= worldRadius)
+				return std::min(std::max(view.bias, 0), lodCount - 1);
+			pixels = worldRadius / distance * view.pixelsPerUnit;
+		}
+
+		// full detail from LOD_FULL_DETAIL_PIXELS radius up, one level coarser each time the size halves
+		int lod = 0;
+		if (pixels < LOD_FULL_DETAIL_PIXELS)
+			lod = pixels > 0.0f ? (int)std::ceil(std::log2(LOD_FULL_DETAIL_PIXELS / pixels)) : lodCount;
+		lod += view.bias;
+
+		return std::min(std::max(lod, 0), lodCount - 1);
+	}
+
+	int Mesh::SelectLod(const LodView& view, const glm::mat4& model) const
+	{
+		return gps::SelectLod(view, model, this->boundingSphere.center, this->boundingSphere.radius, (int)this->lods.size());
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(gps::Shader& shader)
 	{
+		this->Draw(shader, 0);
+	}
+
+	void Mesh::Draw(gps::Shader& shader, int lod)
+	{
+		this->drawElements(shader, lod, 0);
+	}
+
+	void Mesh::DrawInstanced(gps::Shader& shader, const InstanceBuffer& instances, GLsizei count, int lod)
+	{
+		count = std::min(count, instances.getCount());
+		if (count <= 0 || this->lods.empty())
+			return;
+
+		// the attribute pointers are VAO state, only respecify them when the buffer changes
+		if (this->instanceBuffer != instances.getBuffer()) {
+			glBindVertexArray(this->buffers.VAO);
+			instances.bindAttributes();
+			glBindVertexArray(0);
+			this->instanceBuffer = instances.getBuffer();
+		}
+
+		this->drawElements(shader, lod, count);
+	}
+
+	void Mesh::drawElements(gps::Shader& shader, int lod, GLsizei instanceCount)
+	{
+		// moved-from meshes have nothing to draw
+		if (this->lods.empty())
+			return;
+
 		shader.useShaderProgram();
 
 		//set textures
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
+			shader.setUniform(this->textures[i].uniform, (GLint)i);
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
+		//positions are stored relative to the mesh bounding box
+		shader.setUniform(POSITION_OFFSET_UNIFORM, this->positionOffset);
+		shader.setUniform(POSITION_SCALE_UNIFORM, this->positionScale);
+
 		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		lod = std::min(std::max(lod, 0), (int)this->lods.size() - 1);
+		const MeshLod& range = this->lods[lod];
+		const GLvoid* firstIndex = (GLvoid*)((size_t)range.indexOffset * IndexSize(this->indexType));
+		if (instanceCount > 0)
+			glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, this->indexType, firstIndex, instanceCount);
+		else
+			glDrawElements(GL_TRIANGLES, range.indexCount, this->indexType, firstIndex);
 		glBindVertexArray(0);
 
         for(GLuint i = 0; i < this->textures.size(); i++)
@@ -42,6 +231,21 @@ namespace gps {
 
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh(){
+		PackedMesh packed = PackMesh(this->vertices, this->indices);
+		this->setupMesh(packed.GetGeometry());
+	}
+
+	void Mesh::setupMesh(const MeshGeometry& geometry){
+		this->instanceBuffer = 0;
+		this->castsShadows = true;
+		this->indexCount = geometry.indexCount;
+		this->indexType = geometry.indexType;
+		this->positionOffset = geometry.positionOffset;
+		this->positionScale = geometry.positionScale;
+		this->lods.assign(geometry.lods, geometry.lods + geometry.lodCount);
+		this->boundingBox = geometry.boundingBox;
+		this->boundingSphere = geometry.boundingSphere;
+
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
 		glGenBuffers(1, &this->buffers.VBO);
@@ -50,21 +254,21 @@ namespace gps {
 		glBindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, geometry.vertexCount * sizeof(PackedVertex), geometry.vertices, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry.indexCount * IndexSize(geometry.indexType), geometry.indices, GL_STATIC_DRAW);
 
 		// Set the vertex attribute pointers
-		// Vertex Positions
+		// Vertex Positions - normalized 16-bit, the 4th component is padding
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+		// Vertex Normals - 10:10:10:2
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+		// Vertex Texture Coords - half floats
 		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
 
 		glBindVertexArray(0);
 	}
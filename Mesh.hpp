@@ -4,26 +4,24 @@
 #include <GL/glew.h>
 #include "glm/glm.hpp"
 
+#include "InstanceBuffer.hpp"
 #include "Shader.hpp"
+#include "VertexFormat.hpp"
 
 #include <string>
+#include <utility>
 #include <vector>
 
 
 namespace gps {
 
-struct Vertex
-{
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-};
-
 struct Texture
 {
     GLuint id;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
+    //Shader::uniformId of type
+    UniformId uniform;
     std::string path;
 };
 
@@ -34,32 +32,108 @@ struct Material
         glm::vec3 specular;
     };
 
+// Where a level of detail is being chosen from - one per render pass
+struct LodView
+{
+    glm::vec3 eyePosition;
+    // screen pixels covered by one world unit at distance 1, or at any distance if orthographic
+    float pixelsPerUnit;
+    bool orthographic;
+    // added to the chosen level, e.g. to draw coarser shadow casters
+    int bias;
+};
+
+// Projected bounding sphere radius, in pixels, from which a mesh is drawn at full detail
+const float LOD_FULL_DETAIL_PIXELS = 128.0f;
+
+// Level of detail for a bounding sphere given in model space, out of lodCount levels
+int SelectLod(const LodView& view, const glm::mat4& model, glm::vec3 center, float radius, int lodCount);
+
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
 };
 
+// Owns its vertex array and buffers; move-only so the GL objects have exactly one owner
 class Mesh
 {
 public:
+    // CPU copies of the uploaded data - empty unless the mesh was asked to keep them
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
 
+	// Takes over the vectors and keeps them as the CPU copy; uploads them packed
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	// Uploads packed geometry straight into the buffers; with keepCpuData it is also
+	// unpacked into the CPU copy
+	Mesh(const MeshGeometry& geometry, std::vector<Texture> textures, bool keepCpuData = false);
+
+	~Mesh();
+
+	Mesh(Mesh&& other) noexcept;
+	Mesh& operator=(Mesh&& other) noexcept;
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
 	Buffers getBuffers();
 
-	void Draw(gps::Shader shader);
+	// Frees the CPU copies; the GPU buffers stay valid
+	void releaseCpuData();
+
+	// Draws the full detail mesh
+	void Draw(gps::Shader& shader);
+
+	// Draws one level of detail, clamped to the levels the mesh has
+	void Draw(gps::Shader& shader, int lod);
+
+	// Draws count copies of one level of detail, each with the matching matrix of instances
+	void DrawInstanced(gps::Shader& shader, const InstanceBuffer& instances, GLsizei count, int lod = 0);
+
+	// Picks the level of detail from the projected size of the bounding sphere
+	int SelectLod(const LodView& view, const glm::mat4& model) const;
+
+	int getLodCount() const;
+
+	const std::vector<MeshLod>& getLods() const;
+
+	// Model space bounds of the full detail mesh
+	const BoundingBox& getBoundingBox() const;
+	const BoundingSphere& getBoundingSphere() const;
+
+	// Whether the mesh is drawn into shadow maps (true unless its material says otherwise)
+	bool getCastsShadows() const;
+	void setCastsShadows(bool castsShadows);
 
 private:
     /*  Render data  */
     Buffers buffers;
+    GLsizei indexCount;
+    GLenum indexType;
+    // dequantization of the packed positions
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    std::vector<MeshLod> lods;
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+    bool castsShadows;
+    // instance buffer the VAO's instance attributes point at, 0 if none
+    GLuint instanceBuffer;
+
+	// Binds the textures and dequantization, then issues the draw
+	void drawElements(gps::Shader& shader, int lod, GLsizei instanceCount);
 
 	// Initializes all the buffer objects/arrays
 	void setupMesh();
 
+	void setupMesh(const MeshGeometry& geometry);
+
+	// Deletes the GL objects, if any
+	void deleteBuffers();
+
 };
 
 }
@@ -0,0 +1,422 @@
+#include "MeshCache.hpp"
+#include "Hash.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+	static const char MESH_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+	// Bump whenever the cooked layout or the import pipeline output changes
+	static const uint32_t MESH_CACHE_VERSION = 7;
+
+	// bits of the per mesh material flags
+	static const uint32_t MATERIAL_CASTS_SHADOWS = 1;
+
+	struct MeshCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t fileSize;
+		uint32_t sourceCount;
+		uint32_t meshCount;
+	};
+
+	// Size, modification time and content hash of one source file
+	struct SourceStamp
+	{
+		uint64_t size;
+		int64_t mtime;
+		uint64_t hash;
+	};
+
+	// The content hash is only computed with withHash, it reads the whole file
+	static bool StampFile(std::string fileName, SourceStamp& stamp, bool withHash)
+	{
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(fileName.c_str(), &info) != 0)
+			return false;
+#else
+		struct stat info;
+		if (stat(fileName.c_str(), &info) != 0)
+			return false;
+#endif
+		stamp.size = (uint64_t)info.st_size;
+		stamp.mtime = (int64_t)info.st_mtime;
+		stamp.hash = 0;
+
+		return !withHash || HashFile(fileName, stamp.hash);
+	}
+
+	// Replaces target with the finished file at temporary
+	static bool MoveOverCache(const std::string& temporary, const std::string& target)
+	{
+#ifdef _WIN32
+		return MoveFileExA(temporary.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return rename(temporary.c_str(), target.c_str()) == 0;
+#endif
+	}
+
+	// Appends raw bytes to the cooked file being built
+	static void Put(std::vector<unsigned char>& out, const void* bytes, size_t count)
+	{
+		const unsigned char* begin = (const unsigned char*)bytes;
+		out.insert(out.end(), begin, begin + count);
+	}
+
+	static void PutString(std::vector<unsigned char>& out, const std::string& text)
+	{
+		uint32_t length = (uint32_t)text.size();
+		Put(out, &length, sizeof(length));
+		Put(out, text.data(), text.size());
+	}
+
+	static void PutPadding(std::vector<unsigned char>& out)
+	{
+		while (out.size() % 4 != 0)
+			out.push_back(0);
+	}
+
+	// Bounds-checked cursor over the mapped bytes
+	struct CacheReader
+	{
+		const unsigned char* data;
+		size_t size;
+		size_t offset;
+
+		const void* Take(size_t count)
+		{
+			if (count > size - offset)
+				return NULL;
+			const void* result = data + offset;
+			offset += count;
+			return result;
+		}
+
+		template <typename T>
+		bool Get(T& value)
+		{
+			const void* bytes = Take(sizeof(T));
+			if (!bytes)
+				return false;
+			memcpy(&value, bytes, sizeof(T));
+			return true;
+		}
+
+		bool GetString(std::string& text)
+		{
+			uint32_t length;
+			if (!Get(length))
+				return false;
+			const char* bytes = (const char*)Take(length);
+			if (!bytes)
+				return false;
+			text.assign(bytes, length);
+			return true;
+		}
+
+		void SkipPadding()
+		{
+			offset = (offset + 3) & ~(size_t)3;
+			if (offset > size)
+				offset = size;
+		}
+	};
+
+	MeshCache::MeshCache()
+	{
+		data = NULL;
+		size = 0;
+#ifdef _WIN32
+		fileHandle = NULL;
+		mappingHandle = NULL;
+#endif
+	}
+
+	MeshCache::~MeshCache()
+	{
+		Close();
+	}
+
+	std::string MeshCache::CachePath(std::string sourceFile)
+	{
+		return sourceFile + ".meshcache";
+	}
+
+	std::vector<std::string> MeshCache::FindMaterialLibraries(std::string sourceFile, std::string basePath)
+	{
+		std::vector<std::string> libraries;
+		std::ifstream file(sourceFile.c_str());
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.compare(0, 7, "mtllib ") != 0)
+				continue;
+			std::stringstream names(line.substr(7));
+			std::string name;
+			while (names >> name)
+				libraries.push_back(basePath + name);
+		}
+		return libraries;
+	}
+
+	bool MeshCache::Open(std::string sourceFile, std::ostream& log)
+	{
+		Close();
+
+		if (!Map(CachePath(sourceFile)))
+			return false;
+
+		if (!Parse()) {
+			log << "Mesh cache for " << sourceFile << " is stale, re-cooking" << std::endl;
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	const std::vector<CachedMesh>& MeshCache::GetMeshes()
+	{
+		return meshes;
+	}
+
+	bool MeshCache::Parse()
+	{
+		CacheReader reader = { data, size, 0 };
+
+		MeshCacheHeader header;
+		if (!reader.Get(header))
+			return false;
+		if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != MESH_CACHE_VERSION || header.fileSize != size)
+			return false;
+
+		// every source the cooked data was built from must be unchanged
+		for (uint32_t i = 0; i < header.sourceCount; i++) {
+			std::string sourceName;
+			SourceStamp recorded, current;
+			if (!reader.GetString(sourceName) || !reader.Get(recorded))
+				return false;
+			if (!StampFile(sourceName, current, false) || recorded.size != current.size)
+				return false;
+			// a new time on the same size, e.g. after a checkout, is settled by the content
+			if (recorded.mtime != current.mtime && (!StampFile(sourceName, current, true) || recorded.hash != current.hash))
+				return false;
+		}
+
+		for (uint32_t m = 0; m < header.meshCount; m++) {
+			CachedMesh mesh;
+			MeshGeometry& geometry = mesh.geometry;
+			uint32_t indexType, materialFlags, textureCount;
+			if (!reader.Get(geometry.vertexCount) || !reader.Get(geometry.indexCount) || !reader.Get(indexType) ||
+				!reader.Get(geometry.positionOffset) || !reader.Get(geometry.positionScale) ||
+				!reader.Get(geometry.boundingBox) || !reader.Get(geometry.boundingSphere))
+				return false;
+			if (indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT)
+				return false;
+			geometry.indexType = indexType;
+
+			if (!reader.Get(geometry.lodCount) || geometry.lodCount == 0 || geometry.lodCount > MAX_MESH_LODS)
+				return false;
+			for (GLuint l = 0; l < geometry.lodCount; l++) {
+				if (!reader.Get(geometry.lods[l]))
+					return false;
+				if ((uint64_t)geometry.lods[l].indexOffset + geometry.lods[l].indexCount > geometry.indexCount)
+					return false;
+			}
+
+			if (!reader.Get(materialFlags) || !reader.Get(textureCount))
+				return false;
+			mesh.castsShadows = (materialFlags & MATERIAL_CASTS_SHADOWS) != 0;
+			for (uint32_t t = 0; t < textureCount; t++) {
+				CachedTexture texture;
+				if (!reader.GetString(texture.path) || !reader.GetString(texture.type))
+					return false;
+				mesh.textures.push_back(texture);
+			}
+
+			reader.SkipPadding();
+			geometry.vertices = (const PackedVertex*)reader.Take((size_t)geometry.vertexCount * sizeof(PackedVertex));
+			geometry.indices = reader.Take((size_t)geometry.indexCount * IndexSize(geometry.indexType));
+			if (!geometry.vertices || !geometry.indices)
+				return false;
+			reader.SkipPadding();
+
+			meshes.push_back(mesh);
+		}
+
+		return true;
+	}
+
+	bool MeshCache::Write(std::string sourceFile, std::vector<std::string> dependencies, const std::vector<CachedMesh>& meshes,
+		std::ostream& log)
+	{
+		std::vector<std::string> sources;
+		sources.push_back(sourceFile);
+		sources.insert(sources.end(), dependencies.begin(), dependencies.end());
+
+		std::vector<unsigned char> out;
+		MeshCacheHeader header;
+		memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+		header.version = MESH_CACHE_VERSION;
+		header.fileSize = 0;
+		header.sourceCount = (uint32_t)sources.size();
+		header.meshCount = (uint32_t)meshes.size();
+		Put(out, &header, sizeof(header));
+
+		for (size_t i = 0; i < sources.size(); i++) {
+			SourceStamp stamp;
+			if (!StampFile(sources[i], stamp, true))
+				return false;
+			PutString(out, sources[i]);
+			Put(out, &stamp, sizeof(stamp));
+		}
+
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const CachedMesh& mesh = meshes[m];
+			const MeshGeometry& geometry = mesh.geometry;
+			uint32_t indexType = geometry.indexType;
+			uint32_t materialFlags = mesh.castsShadows ? MATERIAL_CASTS_SHADOWS : 0;
+			uint32_t textureCount = (uint32_t)mesh.textures.size();
+			Put(out, &geometry.vertexCount, sizeof(geometry.vertexCount));
+			Put(out, &geometry.indexCount, sizeof(geometry.indexCount));
+			Put(out, &indexType, sizeof(indexType));
+			Put(out, &geometry.positionOffset, sizeof(geometry.positionOffset));
+			Put(out, &geometry.positionScale, sizeof(geometry.positionScale));
+			Put(out, &geometry.boundingBox, sizeof(geometry.boundingBox));
+			Put(out, &geometry.boundingSphere, sizeof(geometry.boundingSphere));
+			Put(out, &geometry.lodCount, sizeof(geometry.lodCount));
+			Put(out, geometry.lods, geometry.lodCount * sizeof(MeshLod));
+			Put(out, &materialFlags, sizeof(materialFlags));
+			Put(out, &textureCount, sizeof(textureCount));
+			for (size_t t = 0; t < mesh.textures.size(); t++) {
+				PutString(out, mesh.textures[t].path);
+				PutString(out, mesh.textures[t].type);
+			}
+			PutPadding(out);
+			Put(out, geometry.vertices, (size_t)geometry.vertexCount * sizeof(PackedVertex));
+			Put(out, geometry.indices, (size_t)geometry.indexCount * IndexSize(geometry.indexType));
+			// 16-bit index arrays can end off a 4 byte boundary
+			PutPadding(out);
+		}
+
+		// patch the total size so truncated files are rejected on load
+		header.fileSize = out.size();
+		memcpy(&out[0], &header, sizeof(header));
+
+		// written next to the cache and moved over it once complete, so a crash or another
+		// instance never leaves a half written cache behind
+		std::string cachePath = CachePath(sourceFile);
+		std::stringstream temporaryPath;
+#ifdef _WIN32
+		temporaryPath << cachePath << "." << GetCurrentProcessId() << ".tmp";
+#else
+		temporaryPath << cachePath << "." << getpid() << ".tmp";
+#endif
+		{
+			std::ofstream file(temporaryPath.str().c_str(), std::ios::binary | std::ios::trunc);
+			if (!file) {
+				log << "WARNING: could not write mesh cache " << cachePath << std::endl;
+				return false;
+			}
+			file.write((const char*)&out[0], out.size());
+			if (!file.good()) {
+				file.close();
+				remove(temporaryPath.str().c_str());
+				log << "WARNING: could not write mesh cache " << cachePath << std::endl;
+				return false;
+			}
+		}
+
+		if (!MoveOverCache(temporaryPath.str(), cachePath)) {
+			remove(temporaryPath.str().c_str());
+			log << "WARNING: could not replace mesh cache " << cachePath << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool MeshCache::Map(std::string fileName)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping) {
+			CloseHandle(file);
+			return false;
+		}
+
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		fileHandle = file;
+		mappingHandle = mapping;
+		size = (size_t)fileSize.QuadPart;
+#else
+		int file = open(fileName.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0) {
+			close(file);
+			return false;
+		}
+
+		void* mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (mapped == MAP_FAILED)
+			return false;
+
+		data = (const unsigned char*)mapped;
+		size = (size_t)info.st_size;
+#endif
+		return true;
+	}
+
+	void MeshCache::Close()
+	{
+		meshes.clear();
+		if (!data)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle((HANDLE)mappingHandle);
+		CloseHandle((HANDLE)fileHandle);
+		fileHandle = NULL;
+		mappingHandle = NULL;
+#else
+		munmap((void*)data, size);
+#endif
+		data = NULL;
+		size = 0;
+	}
+}
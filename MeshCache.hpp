@@ -0,0 +1,76 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Texture reference stored in the cooked file - full path and sampler name
+struct CachedTexture
+{
+    std::string path;
+    std::string type;
+};
+
+// View of one mesh inside a cooked file (or of data about to be written to one)
+struct CachedMesh
+{
+    MeshGeometry geometry;
+    std::vector<CachedTexture> textures;
+    // material flag - see Model3D::SetCastsShadows
+    bool castsShadows;
+};
+
+// Binary, memory-mapped copy of a parsed .obj, stored next to the source file.
+// Layout: header, source file records, then per mesh its dequantization box, bounds,
+// LOD ranges, material flags, a texture table, the interleaved gps::PackedVertex array and the index array.
+class MeshCache
+{
+public:
+    MeshCache();
+    ~MeshCache();
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    // Maps the cooked file of sourceFile; fails if it is missing, corrupt or stale
+    // and says why on log
+    bool Open(std::string sourceFile, std::ostream& log);
+
+    // Unmaps the cooked file - the CachedMesh pointers become invalid
+    void Close();
+
+    const std::vector<CachedMesh>& GetMeshes();
+
+    // Cooks the meshes of sourceFile; dependencies are the other files the result
+    // was built from (e.g. the .mtl libraries) and are validated the same way
+    static bool Write(std::string sourceFile, std::vector<std::string> dependencies, const std::vector<CachedMesh>& meshes,
+        std::ostream& log);
+
+    // Name of the cooked file that belongs to sourceFile
+    static std::string CachePath(std::string sourceFile);
+
+    // Lists the material libraries referenced by an .obj file, relative to basePath
+    static std::vector<std::string> FindMaterialLibraries(std::string sourceFile, std::string basePath);
+
+private:
+    const unsigned char* data;
+    size_t size;
+    std::vector<CachedMesh> meshes;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+
+    bool Map(std::string fileName);
+    bool Parse();
+};
+
+}
+
+#endif /* MeshCache_hpp */
@@ -0,0 +1,223 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+	VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize)
+	{
+		VertexCacheStats stats = { 0.0f, 0.0f };
+		if (indices.empty() || vertexCount == 0)
+			return stats;
+
+		// cacheTime[v] is the miss counter value when v entered the FIFO
+		std::vector<size_t> cacheTime(vertexCount, 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint v = indices[i];
+			if (cacheTime[v] == 0 || misses + 1 - cacheTime[v] > cacheSize) {
+				misses++;
+				cacheTime[v] = misses;
+			}
+		}
+
+		stats.acmr = (float)misses / (float)(indices.size() / 3);
+		stats.atvr = (float)misses / (float)vertexCount;
+		return stats;
+	}
+
+	// Tipsify helper - next vertex from the dead-end stack or, failing that, the input order
+	static int SkipDeadEnd(const std::vector<int>& liveTriangles, std::vector<GLuint>& deadEnds, size_t& cursor)
+	{
+		while (!deadEnds.empty()) {
+			GLuint v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0)
+				return (int)v;
+		}
+
+		while (cursor < liveTriangles.size()) {
+			if (liveTriangles[cursor] > 0)
+				return (int)cursor;
+			cursor++;
+		}
+
+		return -1;
+	}
+
+	void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, std::vector<size_t>& clusters, size_t cacheSize)
+	{
+		size_t triangleCount = indices.size() / 3;
+		clusters.clear();
+		if (triangleCount == 0)
+			return;
+
+		// vertex -> triangle adjacency, in compressed rows
+		std::vector<int> liveTriangles(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			liveTriangles[indices[i]]++;
+
+		std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+		std::vector<GLuint> adjacency(adjacencyOffset[vertexCount]);
+		std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int c = 0; c < 3; c++)
+				adjacency[fill[indices[t * 3 + c]]++] = (GLuint)t;
+
+		std::vector<size_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<GLuint> deadEnds;
+		std::vector<GLuint> candidates;
+		std::vector<GLuint> output;
+		output.reserve(triangleCount * 3);
+
+		size_t timeStamp = cacheSize + 1;
+		size_t cursor = 0;
+		int fanning = SkipDeadEnd(liveTriangles, deadEnds, cursor);
+		clusters.push_back(0);
+
+		while (fanning >= 0) {
+			candidates.clear();
+
+			// emit every remaining triangle around the fanning vertex
+			for (size_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++) {
+				GLuint t = adjacency[a];
+				if (emitted[t])
+					continue;
+
+				for (int c = 0; c < 3; c++) {
+					GLuint v = indices[t * 3 + c];
+					output.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					liveTriangles[v]--;
+					if (timeStamp - cacheTime[v] > cacheSize) {
+						cacheTime[v] = timeStamp;
+						timeStamp++;
+					}
+				}
+				emitted[t] = true;
+			}
+
+			// prefer the candidate that stays in the cache long enough to finish its fan
+			int next = -1;
+			int bestPriority = -1;
+			for (size_t i = 0; i < candidates.size(); i++) {
+				GLuint v = candidates[i];
+				if (liveTriangles[v] <= 0)
+					continue;
+
+				int priority = 0;
+				if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+					priority = (int)(timeStamp - cacheTime[v]);
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					next = (int)v;
+				}
+			}
+
+			if (next == -1) {
+				// hard boundary - the following triangles start a new cluster
+				next = SkipDeadEnd(liveTriangles, deadEnds, cursor);
+				if (next >= 0)
+					clusters.push_back(output.size());
+			}
+
+			fanning = next;
+		}
+
+		indices.swap(output);
+	}
+
+	void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters, float threshold)
+	{
+		if (clusters.size() < 2)
+			return;
+
+		glm::vec3 meshCentroid(0.0f);
+		for (size_t i = 0; i < vertices.size(); i++)
+			meshCentroid += vertices[i].Position;
+		meshCentroid /= (float)vertices.size();
+
+		struct ClusterOrder
+		{
+			size_t begin;
+			size_t end;
+			float sortKey;
+		};
+		std::vector<ClusterOrder> order;
+
+		for (size_t c = 0; c < clusters.size(); c++) {
+			ClusterOrder cluster;
+			cluster.begin = clusters[c];
+			cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+
+			// area weighted normal and centroid of the cluster
+			glm::vec3 normal(0.0f), centroid(0.0f);
+			float area = 0.0f;
+			for (size_t i = cluster.begin; i + 2 < cluster.end; i += 3) {
+				glm::vec3 p0 = vertices[indices[i]].Position;
+				glm::vec3 p1 = vertices[indices[i + 1]].Position;
+				glm::vec3 p2 = vertices[indices[i + 2]].Position;
+				glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+				float triangleArea = glm::length(areaNormal);
+				normal += areaNormal;
+				centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+				area += triangleArea;
+			}
+			if (area > 0.0f)
+				centroid /= area;
+			float normalLength = glm::length(normal);
+			if (normalLength > 0.0f)
+				normal /= normalLength;
+
+			// clusters that face away from the middle of the mesh occlude the others
+			cluster.sortKey = glm::dot(centroid - meshCentroid, normal);
+			order.push_back(cluster);
+		}
+
+		std::stable_sort(order.begin(), order.end(), [](const ClusterOrder& a, const ClusterOrder& b) {
+			return a.sortKey > b.sortKey;
+		});
+
+		std::vector<GLuint> sorted;
+		sorted.reserve(indices.size());
+		for (size_t c = 0; c < order.size(); c++)
+			sorted.insert(sorted.end(), indices.begin() + order[c].begin, indices.begin() + order[c].end);
+
+		// keep the cache order if the cluster order costs too many extra misses
+		float acmrBefore = AnalyzeVertexCache(indices, vertices.size()).acmr;
+		float acmrAfter = AnalyzeVertexCache(sorted, vertices.size()).acmr;
+		if (acmrAfter <= acmrBefore * threshold)
+			indices.swap(sorted);
+	}
+
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		const GLuint UNUSED = 0xFFFFFFFFu;
+		std::vector<GLuint> remap(vertices.size(), UNUSED);
+		std::vector<Vertex> reordered;
+		reordered.reserve(vertices.size());
+
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint& slot = remap[indices[i]];
+			if (slot == UNUSED) {
+				slot = (GLuint)reordered.size();
+				reordered.push_back(vertices[indices[i]]);
+			}
+			indices[i] = slot;
+		}
+
+		vertices.swap(reordered);
+	}
+
+	void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		std::vector<size_t> clusters;
+		OptimizeVertexCache(indices, vertices.size(), clusters);
+		OptimizeOverdraw(indices, vertices, clusters);
+		OptimizeVertexFetch(vertices, indices);
+	}
+}
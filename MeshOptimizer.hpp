@@ -0,0 +1,41 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "VertexFormat.hpp"
+
+#include <vector>
+
+namespace gps {
+
+// Post-transform cache efficiency of an index buffer, measured on a simulated FIFO cache
+struct VertexCacheStats
+{
+    // average cache misses per triangle (0.5 is the ideal for a regular grid, 3 the worst)
+    float acmr;
+    // average vertex shader runs per unique vertex (1 is the ideal)
+    float atvr;
+};
+
+// Size of the FIFO cache used for the statistics and by Tipsify
+const size_t VERTEX_CACHE_SIZE = 16;
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the triangles for the post-transform cache (Tipsify, Sander et al. 2007).
+// clusters receives the index offsets where a new cluster starts, for OptimizeOverdraw.
+void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, std::vector<size_t>& clusters, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the clusters so outward facing ones are drawn first, which lets early-Z
+// reject more of the hidden ones. Reverted if the ACMR grows by more than threshold.
+void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters, float threshold = 1.05f);
+
+// Renumbers the vertices in the order the index buffer first uses them, so vertex
+// fetches walk memory linearly; unreferenced vertices are dropped
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+// Runs the three passes above in order
+void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+}
+
+#endif /* MeshOptimizer_hpp */
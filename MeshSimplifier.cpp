@@ -0,0 +1,242 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+namespace gps {
+
+	// Symmetric 4x4 error quadric, upper triangle only
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+		// quadric of the plane ax + by + cz + d = 0
+		Quadric(double a, double b, double c, double d)
+			: a2(a * a), ab(a * b), ac(a * c), ad(a * d), b2(b * b), bc(b * c), bd(b * d), c2(c * c), cd(c * d), d2(d * d) {}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+			bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+		}
+
+		// sum of squared distances from p to the accumulated planes
+		double Error(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z + d2;
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		GLuint from;
+		GLuint to;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	static uint64_t EdgeKey(GLuint a, GLuint b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	std::vector<GLuint> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount, float maxError)
+	{
+		std::vector<GLuint> triangles(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+		size_t triangleCount = triangles.size() / 3;
+		size_t vertexCount = vertices.size();
+
+		std::vector<Quadric> quadrics(vertexCount);
+		std::vector<std::vector<size_t> > vertexTriangles(vertexCount);
+		std::unordered_map<uint64_t, int> edgeUse;
+
+		for (size_t t = 0; t < triangleCount; t++) {
+			glm::vec3 p0 = vertices[triangles[t * 3]].Position;
+			glm::vec3 p1 = vertices[triangles[t * 3 + 1]].Position;
+			glm::vec3 p2 = vertices[triangles[t * 3 + 2]].Position;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+				normal /= length;
+			Quadric plane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+
+			for (int c = 0; c < 3; c++) {
+				GLuint v = triangles[t * 3 + c];
+				quadrics[v].Add(plane);
+				vertexTriangles[v].push_back(t);
+				edgeUse[EdgeKey(v, triangles[t * 3 + (c + 1) % 3])]++;
+			}
+		}
+
+		// vertices on an open border or a seam (where welding kept split copies) stay put
+		std::vector<bool> locked(vertexCount, false);
+		for (std::unordered_map<uint64_t, int>::iterator edge = edgeUse.begin(); edge != edgeUse.end(); ++edge) {
+			if (edge->second == 1) {
+				locked[(GLuint)(edge->first >> 32)] = true;
+				locked[(GLuint)(edge->first & 0xFFFFFFFFu)] = true;
+			}
+		}
+
+		std::vector<bool> removed(vertexCount, false);
+		std::vector<bool> deadTriangle(triangleCount, false);
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > queue;
+
+		double maxCost = (double)maxError * (double)maxError;
+
+		// queues both directions of every edge around v
+		auto pushEdges = [&](GLuint v) {
+			for (size_t i = 0; i < vertexTriangles[v].size(); i++) {
+				size_t t = vertexTriangles[v][i];
+				if (deadTriangle[t])
+					continue;
+				for (int c = 0; c < 3; c++) {
+					GLuint other = triangles[t * 3 + c];
+					if (other == v)
+						continue;
+					Quadric sum = quadrics[v];
+					sum.Add(quadrics[other]);
+					if (!locked[v]) {
+						Collapse collapse = { sum.Error(vertices[other].Position), v, other };
+						queue.push(collapse);
+					}
+					if (!locked[other]) {
+						Collapse collapse = { sum.Error(vertices[v].Position), other, v };
+						queue.push(collapse);
+					}
+				}
+			}
+		};
+
+		for (GLuint v = 0; v < vertexCount; v++)
+			pushEdges(v);
+
+		size_t liveTriangles = triangleCount;
+		while (liveTriangles * 3 > targetIndexCount && !queue.empty()) {
+			Collapse collapse = queue.top();
+			queue.pop();
+
+			if (collapse.cost > maxCost)
+				break;
+			if (removed[collapse.from] || removed[collapse.to])
+				continue;
+
+			// the quadrics may have grown since this entry was queued
+			Quadric sum = quadrics[collapse.from];
+			sum.Add(quadrics[collapse.to]);
+			double cost = sum.Error(vertices[collapse.to].Position);
+			if (cost > collapse.cost * 1.0001 + 1e-12) {
+				collapse.cost = cost;
+				queue.push(collapse);
+				continue;
+			}
+
+			// the collapse must still be an edge and must not flip any remaining triangle
+			bool isEdge = false;
+			bool flips = false;
+			glm::vec3 target = vertices[collapse.to].Position;
+			std::vector<size_t>& around = vertexTriangles[collapse.from];
+			for (size_t i = 0; i < around.size() && !flips; i++) {
+				size_t t = around[i];
+				if (deadTriangle[t])
+					continue;
+
+				GLuint* corners = &triangles[t * 3];
+				if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+					isEdge = true;
+					continue;
+				}
+
+				glm::vec3 p[3], q[3];
+				for (int c = 0; c < 3; c++) {
+					p[c] = vertices[corners[c]].Position;
+					q[c] = corners[c] == collapse.from ? target : p[c];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if (!isEdge || flips)
+				continue;
+
+			// move every triangle of `from` onto `to`
+			for (size_t i = 0; i < around.size(); i++) {
+				size_t t = around[i];
+				if (deadTriangle[t])
+					continue;
+
+				GLuint* corners = &triangles[t * 3];
+				bool degenerate = false;
+				for (int c = 0; c < 3; c++) {
+					if (corners[c] == collapse.to)
+						degenerate = true;
+					if (corners[c] == collapse.from)
+						corners[c] = collapse.to;
+				}
+
+				if (degenerate) {
+					deadTriangle[t] = true;
+					liveTriangles--;
+				}
+				else {
+					vertexTriangles[collapse.to].push_back(t);
+				}
+			}
+
+			removed[collapse.from] = true;
+			std::vector<size_t>().swap(around);
+			quadrics[collapse.to] = sum;
+			pushEdges(collapse.to);
+		}
+
+		std::vector<GLuint> result;
+		result.reserve(liveTriangles * 3);
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (!deadTriangle[t])
+				result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+		}
+		return result;
+	}
+
+	void BuildLodChain(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, std::vector<MeshLod>& lods)
+	{
+		lods.clear();
+		MeshLod fullDetail = { 0, (GLuint)indices.size() };
+		lods.push_back(fullDetail);
+		if (vertices.empty())
+			return;
+
+		glm::vec3 minimum = vertices[0].Position, maximum = vertices[0].Position;
+		for (size_t i = 1; i < vertices.size(); i++) {
+			minimum = glm::min(minimum, vertices[i].Position);
+			maximum = glm::max(maximum, vertices[i].Position);
+		}
+		float diagonal = glm::length(maximum - minimum);
+
+		std::vector<GLuint> previous(indices);
+		for (int level = 1; level < MAX_MESH_LODS; level++) {
+			// allowed error doubles with every level: 1%, 2%, 4% of the mesh size
+			float maxError = diagonal * 0.01f * (float)(1 << (level - 1));
+			std::vector<GLuint> simplified = SimplifyMesh(vertices, previous, previous.size() / 2, maxError);
+
+			// not worth another draw range if it barely got simpler
+			if (simplified.empty() || simplified.size() > previous.size() * 85 / 100)
+				break;
+
+			std::vector<size_t> clusters;
+			OptimizeVertexCache(simplified, vertices.size(), clusters);
+
+			MeshLod lod = { (GLuint)indices.size(), (GLuint)simplified.size() };
+			lods.push_back(lod);
+			indices.insert(indices.end(), simplified.begin(), simplified.end());
+			previous.swap(simplified);
+		}
+	}
+}
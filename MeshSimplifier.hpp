@@ -0,0 +1,24 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "VertexFormat.hpp"
+
+#include <vector>
+
+namespace gps {
+
+// Quadric error metric simplification (Garland & Heckbert 1997) by half-edge collapses.
+// Vertices only ever collapse onto other existing vertices, so the result indexes the
+// same vertex array and keeps its normals and texture coordinates. Open borders and
+// texture seams are locked so the mesh does not tear. Stops once the index count
+// reaches targetIndexCount or the next collapse would move the surface by more than
+// maxError (in model units).
+std::vector<GLuint> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount, float maxError);
+
+// Appends up to MAX_MESH_LODS - 1 coarser versions of the mesh to indices, each with about
+// half the triangles of the previous one, and describes every level in lods
+void BuildLodChain(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, std::vector<MeshLod>& lods);
+
+}
+
+#endif /* MeshSimplifier_hpp */
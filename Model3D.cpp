@@ -1,29 +1,308 @@
 #include "Model3D.hpp"
 
+#include <cstdlib>
+
 namespace gps {
 
+	// until a pass sets its view everything is drawn at full detail
+	LodView Model3D::lodView = { glm::vec3(0.0f), 1.0e9f, true, 0 };
+	// and nothing is culled
+	Frustum Model3D::cullFrustum = Frustum::Everything();
+	bool Model3D::shadowPass = false;
+
+	Model3D::Model3D()
+	{
+		batched = false;
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
-		ReadOBJ(fileName, basePath);
+		// without a pool the decoder works synchronously
+		TextureDecoder decoder;
+		if (!Parse(fileName, basePath, decoder)) {
+			FlushLog();
+			exit(1);
+		}
+		Upload();
+	}
+
+	bool Model3D::Parse(std::string fileName, TextureDecoder& decoder)
+	{
+		std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		return Parse(fileName, basePath, decoder);
+	}
+
+	// CPU phase of loading - reads the cooked file or the .obj and queues the texture decodes
+	bool Model3D::Parse(std::string fileName, std::string basePath, TextureDecoder& decoder)
+	{
+		if (cache.Open(fileName, parseLog)) {
+			parseLog << "Loading : " << fileName << " (cached)" << std::endl;
+			pendingMeshes = cache.GetMeshes();
+		}
+		else {
+			if (!ReadOBJ(fileName, basePath))
+				return false;
+			OptimizeMeshes(fileName);
+			BuildLods();
+
+			for (size_t m = 0; m < parsedMeshes.size(); m++) {
+				parsedMeshes[m].packed = PackMesh(parsedMeshes[m].vertices, parsedMeshes[m].indices, parsedMeshes[m].lods);
+
+				CachedMesh pendingMesh;
+				pendingMesh.geometry = parsedMeshes[m].packed.GetGeometry();
+				pendingMesh.textures = parsedMeshes[m].textures;
+				pendingMesh.castsShadows = parsedMeshes[m].castsShadows;
+				pendingMeshes.push_back(pendingMesh);
+			}
+
+			MeshCache::Write(fileName, MeshCache::FindMaterialLibraries(fileName, basePath), pendingMeshes, parseLog);
+		}
+
+		// queue every image the meshes reference, once per path
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+			for (size_t t = 0; t < pendingMeshes[m].textures.size(); t++) {
+				const CachedTexture& texture = pendingMeshes[m].textures[t];
+
+				bool alreadyQueued = false;
+				for (size_t i = 0; i < pendingImages.size(); i++)
+					alreadyQueued = alreadyQueued || pendingImages[i].texture.path == texture.path;
+				if (alreadyQueued)
+					continue;
+
+				PendingImage image;
+				image.texture = texture;
+				// shared with a model loaded earlier - no need to decode it again
+				if (!TextureCache::IsResident(texture.path))
+					image.job = decoder.Decode(texture.path, 4, true);
+				pendingImages.push_back(image);
+			}
+		}
+
+		return true;
+	}
+
+	// GL phase of loading - creates the textures and buffers from what Parse produced
+	void Model3D::Upload()
+	{
+		FlushLog();
+
+		for (size_t i = 0; i < pendingImages.size(); i++) {
+			TextureDecoder::Handle job = pendingImages[i].job;
+			std::string path = pendingImages[i].texture.path;
+
+			// the decoder hashed the file while reading it, off the GL thread
+			const uint64_t* contentHash = NULL;
+			if (job) {
+				const TextureImage& image = TextureDecoder::Wait(job);
+				if (image.hashed)
+					contentHash = &image.contentHash;
+			}
+
+			gps::Texture currentTexture;
+			currentTexture.id = TextureCache::Acquire(path, contentHash, [job, path] {
+				if (job)
+					return UploadTexture(TextureDecoder::Wait(job));
+
+				// it was resident during Parse but has been released since
+				TextureImage image;
+				TextureDecoder::DecodeFile(path, 4, true, image);
+				return UploadTexture(image);
+			});
+			currentTexture.type = pendingImages[i].texture.type;
+			currentTexture.uniform = Shader::uniformId(currentTexture.type);
+			currentTexture.path = pendingImages[i].texture.path;
+			loadedTextures.push_back(currentTexture);
+		}
+		pendingImages.clear();
+
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < pendingMeshes[m].textures.size(); t++)
+				textures.push_back(LoadTexture(pendingMeshes[m].textures[t].path, pendingMeshes[m].textures[t].type));
+
+			if (batched) {
+				// the batch reads the packed arrays where they are, nothing goes to the GPU yet
+				BatchMesh batchMesh;
+				batchMesh.geometry = pendingMeshes[m].geometry;
+				batchMesh.textures = std::move(textures);
+				batchMesh.castsShadows = pendingMeshes[m].castsShadows;
+				batchMeshes.push_back(batchMesh);
+				continue;
+			}
+
+			// parsed or memory-mapped arrays go to glBufferData as they are
+			meshes.emplace_back(pendingMeshes[m].geometry, std::move(textures));
+			meshes.back().setCastsShadows(pendingMeshes[m].castsShadows);
+		}
+
+		pendingMeshes.clear();
+		if (!batched) {
+			parsedMeshes.clear();
+			cache.Close();
+		}
+	}
+
+	void Model3D::FlushLog()
+	{
+		std::cout << parseLog.str() << std::flush;
+		parseLog.str("");
+	}
+
+	void Model3D::SetBatched(bool batched)
+	{
+		this->batched = batched;
+	}
+
+	const std::vector<BatchMesh>& Model3D::GetBatchMeshes() const
+	{
+		return batchMeshes;
+	}
+
+	void Model3D::ReleaseBatchMeshes()
+	{
+		batchMeshes.clear();
+		parsedMeshes.clear();
+		cache.Close();
+	}
+
+	// Reorders the parsed meshes for the post-transform cache, overdraw and vertex fetch
+	void Model3D::OptimizeMeshes(std::string fileName)
+	{
+		double missesBefore = 0.0, missesAfter = 0.0;
+		size_t triangles = 0, vertexCount = 0;
+
+		for (size_t m = 0; m < parsedMeshes.size(); m++) {
+			MeshData& mesh = parsedMeshes[m];
+			VertexCacheStats before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+			OptimizeMesh(mesh.vertices, mesh.indices);
+			VertexCacheStats after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+			missesBefore += before.acmr * (mesh.indices.size() / 3);
+			missesAfter += after.acmr * (mesh.indices.size() / 3);
+			triangles += mesh.indices.size() / 3;
+			vertexCount += mesh.vertices.size();
+		}
+
+		if (triangles == 0 || vertexCount == 0)
+			return;
+
+		parseLog << "Vertex cache : " << fileName
+			<< " ACMR " << missesBefore / triangles << " -> " << missesAfter / triangles
+			<< ", ATVR " << missesBefore / vertexCount << " -> " << missesAfter / vertexCount << std::endl;
+	}
+
+	void Model3D::BuildLods()
+	{
+		for (size_t m = 0; m < parsedMeshes.size(); m++) {
+			MeshData& mesh = parsedMeshes[m];
+			size_t fullDetail = mesh.indices.size();
+			BuildLodChain(mesh.vertices, mesh.indices, mesh.lods);
+
+			parseLog << "  mesh " << m << " : " << mesh.lods.size() << " LODs,";
+			for (size_t l = 0; l < mesh.lods.size(); l++)
+				parseLog << " " << mesh.lods[l].indexCount / 3;
+			parseLog << " triangles (" << mesh.indices.size() - fullDetail << " extra indices)" << std::endl;
+		}
+	}
+
+	void Model3D::SetCastsShadows(bool castsShadows)
+	{
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshes[i].setCastsShadows(castsShadows);
+		for (size_t i = 0; i < batchMeshes.size(); i++)
+			batchMeshes[i].castsShadows = castsShadows;
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(gps::Shader& shaderProgram)
 	{
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	void Model3D::Draw(gps::Shader& shaderProgram, const glm::mat4& model)
+	{
+		cullSpheres.resize(meshes.size());
+		cullBoxes.resize(meshes.size());
+		cullVisible.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			cullSpheres[i] = TransformSphere(meshes[i].getBoundingSphere(), model);
+			cullBoxes[i] = TransformBox(meshes[i].getBoundingBox(), model);
+		}
+		CullBounds(cullFrustum, cullSpheres.data(), cullBoxes.data(), meshes.size(), cullVisible.data());
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (cullVisible[i] && (!shadowPass || meshes[i].getCastsShadows()))
+				meshes[i].Draw(shaderProgram, meshes[i].SelectLod(lodView, model));
+		}
+	}
+
+	void Model3D::DrawInstanced(gps::Shader& shaderProgram, const InstanceBuffer& instances, GLsizei count, int lod)
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (!shadowPass || meshes[i].getCastsShadows())
+				meshes[i].DrawInstanced(shaderProgram, instances, count, lod);
+		}
+	}
+
+	void Model3D::SetLodView(const LodView& view)
+	{
+		lodView = view;
+	}
+
+	const LodView& Model3D::GetLodView()
+	{
+		return lodView;
+	}
+
+	void Model3D::SetCullFrustum(const Frustum& frustum)
+	{
+		cullFrustum = frustum;
+	}
+
+	const Frustum& Model3D::GetCullFrustum()
+	{
+		return cullFrustum;
+	}
+
+	void Model3D::SetShadowPass(bool shadowPass)
+	{
+		Model3D::shadowPass = shadowPass;
+	}
+
+	bool Model3D::IsShadowPass()
+	{
+		return shadowPass;
+	}
+
+	std::vector<gps::Mesh>& Model3D::GetMeshes()
+	{
+		return meshes;
+	}
+
+	BoundingBox Model3D::GetBoundingBox() const
+	{
+		BoundingBox box = { glm::vec3(0.0f), glm::vec3(0.0f) };
+		// a model has either meshes or batch meshes
+		size_t count = meshes.size() + batchMeshes.size();
+		for (size_t i = 0; i < count; i++) {
+			const BoundingBox& meshBox = i < meshes.size() ? meshes[i].getBoundingBox() : batchMeshes[i - meshes.size()].geometry.boundingBox;
+			box.minimum = i == 0 ? meshBox.minimum : glm::min(box.minimum, meshBox.minimum);
+			box.maximum = i == 0 ? meshBox.maximum : glm::max(box.maximum, meshBox.maximum);
+		}
+		return box;
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+	bool Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
-        std::cout << "Loading : " << fileName << std::endl;
+        parseLog << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
@@ -33,29 +312,50 @@ namespace gps {
 		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
 
 		if (!err.empty()) { // `err` may contain warning message.
-			std::cerr << err << std::endl;
+			parseLog << err << std::endl;
 		}
 
 		if (!ret) {
-			exit(1);
+			parseLog << "ERROR: could not load " << fileName << std::endl;
+			return false;
 		}
 
-		std::cout << "# of shapes    : " << shapes.size() << std::endl;
-		std::cout << "# of materials : " << materials.size() << std::endl;
+		parseLog << "# of shapes    : " << shapes.size() << std::endl;
+		parseLog << "# of materials : " << materials.size() << std::endl;
+
+		// One submesh per material - faces of every shape that use it are merged together
+		std::vector<int> submeshMaterials;
+		std::unordered_map<int, size_t> submeshByMaterial;
+		// Maps an already emitted vertex of a submesh to its slot, so shared corners are welded
+		std::vector<std::unordered_map<gps::Vertex, GLuint, gps::VertexHash> > uniqueVertices;
 
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
 			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
 				int fv = shapes[s].mesh.num_face_vertices[f];
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
+				// get material id of this face
+				// Only use materials if the .mtl file is present
+				materialId = -1;
+				if (f < shapes[s].mesh.material_ids.size() && materials.size() > 0) {
+					materialId = shapes[s].mesh.material_ids[f];
+					if (materialId < 0 || materialId >= (int)materials.size())
+						materialId = -1;
+				}
+
+				auto submesh = submeshByMaterial.find(materialId);
+				if (submesh == submeshByMaterial.end()) {
+					submesh = submeshByMaterial.emplace(materialId, parsedMeshes.size()).first;
+					submeshMaterials.push_back(materialId);
+					uniqueVertices.push_back(std::unordered_map<gps::Vertex, GLuint, gps::VertexHash>());
+					parsedMeshes.push_back(MeshData());
+				}
+				std::vector<gps::Vertex>& vertices = parsedMeshes[submesh->second].vertices;
+				std::vector<GLuint>& indices = parsedMeshes[submesh->second].indices;
+				std::unordered_map<gps::Vertex, GLuint, gps::VertexHash>& welded = uniqueVertices[submesh->second];
 
 				// Loop over vertices in the face.
 				for (size_t v = 0; v < fv; v++) {
@@ -84,56 +384,75 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
-					vertices.push_back(currentVertex);
-
-					indices.push_back(index_offset + v);
+					auto found = welded.find(currentVertex);
+					if (found == welded.end()) {
+						GLuint newIndex = (GLuint)vertices.size();
+						welded.emplace(currentVertex, newIndex);
+						vertices.push_back(currentVertex);
+						indices.push_back(newIndex);
+					}
+					else {
+						indices.push_back(found->second);
+					}
 				}
 
 				index_offset += fv;
 			}
+		}
 
-			// get material id
-			// Only try to read materials if the .mtl file is present
-			int a = shapes[s].mesh.material_ids.size();
-			if (a > 0 && materials.size()>0) {
-				materialId = shapes[s].mesh.material_ids[0];
-				if (materialId != -1) {
-					gps::Material currentMaterial;
-					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
-
-					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
-					if (!ambientTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
-					}
+		for (size_t m = 0; m < parsedMeshes.size(); m++) {
+			std::vector<CachedTexture>& textures = parsedMeshes[m].textures;
+			materialId = submeshMaterials[m];
+			parsedMeshes[m].castsShadows = true;
+			if (materialId != -1) {
+				// see-through materials let the light pass, and any can opt out explicitly
+				auto castsShadows = materials[materialId].unknown_parameter.find("casts_shadows");
+				parsedMeshes[m].castsShadows = materials[materialId].dissolve >= 1.0f &&
+					(castsShadows == materials[materialId].unknown_parameter.end() || std::atoi(castsShadows->second.c_str()) != 0);
+
+				gps::Material currentMaterial;
+				currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
+				currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
+				currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
+
+				//ambient texture
+				std::string ambientTexturePath = materials[materialId].ambient_texname;
+				if (!ambientTexturePath.empty())
+				{
+					CachedTexture currentTexture;
+					currentTexture.path = basePath + ambientTexturePath;
+					currentTexture.type = "ambientTexture";
+					textures.push_back(currentTexture);
+				}
 
-					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
-					if (!diffuseTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
-					}
+				//diffuse texture
+				std::string diffuseTexturePath = materials[materialId].diffuse_texname;
+				if (!diffuseTexturePath.empty())
+				{
+					CachedTexture currentTexture;
+					currentTexture.path = basePath + diffuseTexturePath;
+					currentTexture.type = "diffuseTexture";
+					textures.push_back(currentTexture);
+				}
 
-					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
-					if (!specularTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
-					}
+				//specular texture
+				std::string specularTexturePath = materials[materialId].specular_texname;
+				if (!specularTexturePath.empty())
+				{
+					CachedTexture currentTexture;
+					currentTexture.path = basePath + specularTexturePath;
+					currentTexture.type = "specularTexture";
+					textures.push_back(currentTexture);
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			parseLog << "  material " << (materialId != -1 ? materials[materialId].name : std::string("(none)")) << " : "
+				<< parsedMeshes[m].indices.size() << " corners welded into " << parsedMeshes[m].vertices.size() << " vertices"
+				<< (parsedMeshes[m].castsShadows ? "" : ", casts no shadow") << std::endl;
 		}
+
+		parseLog << "# of submeshes : " << parsedMeshes.size() << std::endl;
+		return true;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
@@ -148,8 +467,14 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = TextureCache::Acquire(path, NULL, [path] {
+				// not decoded by Parse - load it synchronously
+				TextureImage image;
+				TextureDecoder::DecodeFile(path, 4, true, image);
+				return UploadTexture(image);
+			});
 			currentTexture.type = std::string(type);
+			currentTexture.uniform = Shader::uniformId(currentTexture.type);
 			currentTexture.path = path;
 
 			loadedTextures.push_back(currentTexture);
@@ -157,40 +482,18 @@ namespace gps {
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
+	// Loads decoded pixel data into the video memory
+	GLuint Model3D::UploadTexture(const TextureImage& image) {
+		if (!image.pixels) {
 			return false;
 		}
 		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+		if ((image.width & (image.width - 1)) != 0 || (image.height & (image.height - 1)) != 0) {
 			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
+				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", image.path.c_str()
 			);
 		}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
-
 		GLuint textureID;
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_2D, textureID);
@@ -198,12 +501,12 @@ namespace gps {
 			GL_TEXTURE_2D,
 			0,
 			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
+			image.width,
+			image.height,
 			0,
 			GL_RGBA,
 			GL_UNSIGNED_BYTE,
-			image_data
+			image.pixels
 		);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -218,16 +521,9 @@ namespace gps {
 
 	Model3D::~Model3D() {
         for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+            TextureCache::Release(loadedTextures.at(i).id);
         }
 
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
-        }
+        // the meshes delete their own buffers
 	}
 }
@@ -1,43 +1,164 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "Frustum.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "TextureCache.hpp"
+#include "TextureDecoder.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gps {
 
+    // Mesh of a batched model, left on the CPU for a StaticBatch to merge
+    struct BatchMesh
+    {
+        // points into the mesh cache or the parsed data of the model
+        MeshGeometry geometry;
+        std::vector<Texture> textures;
+        bool castsShadows;
+    };
+
     class Model3D
     {
 
     public:
+        Model3D();
         ~Model3D();
 
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// CPU half of LoadModel - makes no GL calls and prints nothing, so it may run on a
+		// worker thread. Texture images are queued on the decoder, which must outlive Upload().
+		// Fails if the .obj cannot be read; the reason is in the log.
+		bool Parse(std::string fileName, TextureDecoder& decoder);
+
+		bool Parse(std::string fileName, std::string basePath, TextureDecoder& decoder);
+
+		// GL half of LoadModel - prints the log and uploads what Parse produced, on the GL thread
+		void Upload();
+
+		// Prints and clears what Parse logged
+		void FlushLog();
+
+		// Whether Upload leaves the packed geometry on the CPU for a StaticBatch instead of
+		// giving every mesh its own GL buffers (off by default); the model then draws nothing
+		void SetBatched(bool batched);
+
+		// Geometry kept by SetBatched(true), valid until ReleaseBatchMeshes
+		const std::vector<BatchMesh>& GetBatchMeshes() const;
+
+		// Frees the geometry kept by SetBatched(true), once the batches are built
+		void ReleaseBatchMeshes();
+
+		// Sets whether every mesh casts shadows, overriding the materials. A material casts
+		// unless it is see-through (d < 1) or its .mtl entry has "casts_shadows 0".
+		void SetCastsShadows(bool castsShadows);
+
+		// Draws every mesh at full detail
+		void Draw(gps::Shader& shaderProgram);
+
+		// Draws the meshes inside the cull frustum, each at the level of detail its size
+		// on screen calls for
+		void Draw(gps::Shader& shaderProgram, const glm::mat4& model);
+
+		// Draws count copies of every mesh in one call each, placed by the matrices in
+		// instances (applied before the model uniform); needs the *Instanced.vert shaders,
+		// which take the instances to be rigid or uniformly scaled
+		void DrawInstanced(gps::Shader& shaderProgram, const InstanceBuffer& instances, GLsizei count, int lod = 0);
+
+		// Sets the view the level of detail is chosen for - call once per render pass
+		static void SetLodView(const LodView& view);
+
+		static const LodView& GetLodView();
+
+		// Sets the world space frustum meshes are culled against - call once per render pass
+		static void SetCullFrustum(const Frustum& frustum);
+
+		static const Frustum& GetCullFrustum();
+
+		// Marks the passes that render shadow casters, which leave out the meshes that cast none
+		static void SetShadowPass(bool shadowPass);
+
+		static bool IsShadowPass();
+
+		std::vector<gps::Mesh>& GetMeshes();
+
+		// Model space box around every mesh
+		BoundingBox GetBoundingBox() const;
 
     private:
+		// Geometry of one shape, parsed from the .obj and waiting for upload
+		struct MeshData
+		{
+			std::vector<gps::Vertex> vertices;
+			// every level of detail, one after the other
+			std::vector<GLuint> indices;
+			std::vector<MeshLod> lods;
+			std::vector<CachedTexture> textures;
+			bool castsShadows;
+			// quantized copy that gets cooked and uploaded
+			PackedMesh packed;
+		};
+
+		// Texture whose pixels are being decoded for upload
+		struct PendingImage
+		{
+			CachedTexture texture;
+			TextureDecoder::Handle job;
+		};
+
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
+		bool batched;
+		std::vector<BatchMesh> batchMeshes;
+		// Associated textures - one TextureCache reference each
         std::vector<gps::Texture> loadedTextures;
 
+		static LodView lodView;
+		static Frustum cullFrustum;
+		static bool shadowPass;
+
+		// world space bounds of the meshes, rebuilt by every culled Draw
+		std::vector<BoundingSphere> cullSpheres;
+		std::vector<BoundingBox> cullBoxes;
+		std::vector<unsigned char> cullVisible;
+
+		// Results of Parse that Upload consumes; a batched model keeps the cache mapped and
+		// the parsed meshes until ReleaseBatchMeshes, its batch meshes point into them
+		MeshCache cache;
+		std::vector<MeshData> parsedMeshes;
+		std::vector<CachedMesh> pendingMeshes;
+		std::vector<PendingImage> pendingImages;
+		// messages of Parse, kept so loaders on several threads do not interleave
+		std::stringstream parseLog;
+
 		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		bool ReadOBJ(std::string fileName, std::string basePath);
+
+		// Reorders the parsed meshes for the post-transform cache, overdraw and vertex fetch
+		void OptimizeMeshes(std::string fileName);
+
+		// Appends the simplified levels of detail to every parsed mesh
+		void BuildLods();
 
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Loads decoded pixel data into the video memory
+		static GLuint UploadTexture(const TextureImage& image);
     };
 }
 
@@ -0,0 +1,66 @@
+#include "ModelLoader.hpp"
+
+#include <chrono>
+
+namespace gps {
+
+    ModelLoader::ModelLoader(size_t threadCount) : decoder(&pool), pool(threadCount)
+    {
+
+    }
+
+    void ModelLoader::Add(gps::Model3D& model, std::string fileName)
+    {
+        PendingModel pendingModel;
+        pendingModel.model = &model;
+        pendingModel.parseSucceeded = std::make_shared<bool>(false);
+        std::shared_ptr<bool> parseSucceeded = pendingModel.parseSucceeded;
+        TextureDecoder* textureDecoder = &decoder;
+        pendingModel.parsed = pool.Submit([&model, fileName, textureDecoder, parseSucceeded] {
+            *parseSucceeded = model.Parse(fileName, *textureDecoder);
+        });
+        pendingModels.push_back(std::move(pendingModel));
+    }
+
+    void ModelLoader::Add(gps::SkyBox& skyBox, std::vector<const GLchar*> cubeMapFaces)
+    {
+        skyBox.Parse(cubeMapFaces, decoder);
+        pendingSkyBoxes.push_back(&skyBox);
+    }
+
+    bool ModelLoader::Finish()
+    {
+        bool allParsed = true;
+
+        while (!pendingModels.empty()) {
+            bool uploaded = false;
+
+            for (size_t i = 0; i < pendingModels.size(); i++) {
+                if (pendingModels[i].parsed.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    continue;
+
+                // rethrows anything the worker threw
+                pendingModels[i].parsed.get();
+                if (*pendingModels[i].parseSucceeded) {
+                    pendingModels[i].model->Upload();
+                }
+                else {
+                    pendingModels[i].model->FlushLog();
+                    allParsed = false;
+                }
+                pendingModels.erase(pendingModels.begin() + i);
+                uploaded = true;
+                break;
+            }
+
+            if (!uploaded)
+                pendingModels.front().parsed.wait_for(std::chrono::milliseconds(1));
+        }
+
+        for (size_t i = 0; i < pendingSkyBoxes.size(); i++)
+            pendingSkyBoxes[i]->Upload();
+        pendingSkyBoxes.clear();
+
+        return allParsed;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef ModelLoader_hpp
+#define ModelLoader_hpp
+
+#include "Model3D.hpp"
+#include "SkyBox.hpp"
+#include "TextureDecoder.hpp"
+#include "ThreadPool.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Loads several models and skyboxes at once: parsing and every texture decode run
+// on a worker pool, while the GL uploads happen on the thread that calls Finish()
+class ModelLoader
+{
+public:
+    // threadCount = 0 uses one worker per hardware thread
+    ModelLoader(size_t threadCount = 0);
+
+    // Starts parsing fileName into model on a worker
+    void Add(gps::Model3D& model, std::string fileName);
+
+    // Starts decoding the six faces of skyBox on the pool
+    void Add(gps::SkyBox& skyBox, std::vector<const GLchar*> cubeMapFaces);
+
+    // Uploads every model as soon as its worker is done and prints what it logged; must be
+    // called on the GL thread. Fails if a model could not be parsed - the others are still uploaded.
+    bool Finish();
+
+private:
+    struct PendingModel
+    {
+        gps::Model3D* model;
+        std::future<void> parsed;
+        // written by the worker before parsed becomes ready
+        std::shared_ptr<bool> parseSucceeded;
+    };
+
+    // declared before the pool so the workers are joined before the jobs go away
+    TextureDecoder decoder;
+    ThreadPool pool;
+    std::vector<PendingModel> pendingModels;
+    std::vector<gps::SkyBox*> pendingSkyBoxes;
+};
+
+}
+
+#endif /* ModelLoader_hpp */
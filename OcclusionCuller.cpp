@@ -0,0 +1,188 @@
+#include "OcclusionCuller.hpp"
+
+#include "glm/gtc/type_ptr.hpp"
+
+namespace gps {
+
+	static const UniformId LIGHT_SPACE_UNIFORM = Shader::uniformId("lightSpaceTrMatrix");
+	static const UniformId POSITION_OFFSET_UNIFORM = Shader::uniformId("positionOffset");
+	static const UniformId POSITION_SCALE_UNIFORM = Shader::uniformId("positionScale");
+
+	OcclusionCuller::OcclusionCuller()
+	{
+		enabled = false;
+		current = 0;
+		conditionActive = false;
+		stats.queried = 0;
+		stats.occluded = 0;
+		boxVAO = 0;
+		boxVBO = 0;
+		boxEBO = 0;
+	}
+
+	OcclusionCuller::~OcclusionCuller()
+	{
+		DeleteQueries();
+		glDeleteBuffers(1, &boxVBO);
+		glDeleteBuffers(1, &boxEBO);
+		glDeleteVertexArrays(1, &boxVAO);
+	}
+
+	void OcclusionCuller::SetEnabled(bool enabled)
+	{
+		this->enabled = enabled;
+		// results from before the switch may be arbitrarily old
+		for (int set = 0; set < 2; set++)
+			issued[set].assign(issued[set].size(), 0);
+	}
+
+	bool OcclusionCuller::IsEnabled() const
+	{
+		return enabled;
+	}
+
+	void OcclusionCuller::DeleteQueries()
+	{
+		for (int set = 0; set < 2; set++) {
+			if (!queries[set].empty())
+				glDeleteQueries((GLsizei)queries[set].size(), queries[set].data());
+			queries[set].clear();
+			issued[set].clear();
+		}
+	}
+
+	void OcclusionCuller::BeginFrame(size_t itemCount)
+	{
+		stats.queried = 0;
+		stats.occluded = 0;
+		if (!enabled)
+			return;
+
+		if (queries[0].size() != itemCount) {
+			DeleteQueries();
+			for (int set = 0; set < 2; set++) {
+				queries[set].resize(itemCount);
+				issued[set].assign(itemCount, 0);
+				if (itemCount > 0)
+					glGenQueries((GLsizei)itemCount, queries[set].data());
+			}
+		}
+
+		// last frame's set decides the draws, this frame's boxes go into the other one
+		current ^= 1;
+		int previous = current ^ 1;
+
+		// counted only where the result is already there - asking for it must never stall
+		for (size_t i = 0; i < itemCount; i++) {
+			if (!issued[previous][i])
+				continue;
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(queries[previous][i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+			GLuint anySamples = GL_TRUE;
+			glGetQueryObjectuiv(queries[previous][i], GL_QUERY_RESULT, &anySamples);
+			stats.queried++;
+			stats.occluded += anySamples ? 0 : 1;
+		}
+		issued[current].assign(itemCount, 0);
+	}
+
+	void OcclusionCuller::BeginItem(size_t item)
+	{
+		int previous = current ^ 1;
+		if (!enabled || item >= issued[previous].size() || !issued[previous][item])
+			return;
+
+		// NO_WAIT draws the item anyway if the result has not arrived yet
+		glBeginConditionalRender(queries[previous][item], GL_QUERY_NO_WAIT);
+		conditionActive = true;
+	}
+
+	void OcclusionCuller::EndItem()
+	{
+		if (!conditionActive)
+			return;
+		glEndConditionalRender();
+		conditionActive = false;
+	}
+
+	void OcclusionCuller::CreateBox()
+	{
+		const GLushort corners[8][4] = {
+			{ 0, 0, 0, 0 }, { 65535, 0, 0, 0 }, { 65535, 65535, 0, 0 }, { 0, 65535, 0, 0 },
+			{ 0, 0, 65535, 0 }, { 65535, 0, 65535, 0 }, { 65535, 65535, 65535, 0 }, { 0, 65535, 65535, 0 }
+		};
+		const GLubyte faces[36] = {
+			0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+			3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+		};
+
+		glGenVertexArrays(1, &boxVAO);
+		glGenBuffers(1, &boxVBO);
+		glGenBuffers(1, &boxEBO);
+
+		glBindVertexArray(boxVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+
+		// same position attribute as the meshes
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(corners[0]), (GLvoid*)0);
+		glBindVertexArray(0);
+	}
+
+	void OcclusionCuller::IssueQueries(gps::Shader& boxShader, const glm::mat4& viewProjection, const glm::mat4& model,
+		const std::vector<BoundingBox>& boxes, const std::vector<unsigned char>& candidates)
+	{
+		if (!enabled || boxes.size() != queries[current].size())
+			return;
+		if (!boxVAO)
+			CreateBox();
+
+		// boxes crossing the near plane get clipped and would look hidden - they just stay unqueried
+		Frustum frustum = Frustum::FromMatrix(viewProjection).Transformed(model);
+		const glm::vec4& nearPlane = frustum.planes[4];
+
+		boxShader.useShaderProgram();
+		boxShader.setUniform(LIGHT_SPACE_UNIFORM, viewProjection);
+
+		// test against the depth buffer without touching it
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+		glDisable(GL_CULL_FACE);
+		glBindVertexArray(boxVAO);
+
+		for (size_t i = 0; i < boxes.size(); i++) {
+			if (!candidates[i])
+				continue;
+
+			glm::vec3 center = (boxes[i].minimum + boxes[i].maximum) * 0.5f;
+			glm::vec3 extent = (boxes[i].maximum - boxes[i].minimum) * 0.5f;
+			float radius = glm::dot(glm::abs(glm::vec3(nearPlane)), extent);
+			if (glm::dot(glm::vec3(nearPlane), center) + nearPlane.w < radius)
+				continue;
+
+			glm::vec3 scale = glm::max(boxes[i].maximum - boxes[i].minimum, glm::vec3(1.0e-4f));
+			boxShader.setUniform(POSITION_OFFSET_UNIFORM, boxes[i].minimum);
+			boxShader.setUniform(POSITION_SCALE_UNIFORM, scale);
+
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[current][i]);
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+			issued[current][i] = 1;
+		}
+
+		glBindVertexArray(0);
+		glEnable(GL_CULL_FACE);
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+
+	const OcclusionStats& OcclusionCuller::GetStats() const
+	{
+		return stats;
+	}
+}
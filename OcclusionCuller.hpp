@@ -0,0 +1,76 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "Frustum.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+struct OcclusionStats
+{
+    // items whose box was drawn into a query last frame
+    size_t queried;
+    // of those, the ones no sample of the box passed the depth test for
+    size_t occluded;
+};
+
+// Hardware occlusion culling for one render pass. Every frame the boxes of the items are
+// drawn into GL_ANY_SAMPLES_PASSED queries after the occluders, and the next frame draws
+// each item under glBeginConditionalRender on that query. Using last frame's result keeps
+// the CPU from ever waiting on the GPU; an item that just came into view may show up a
+// frame late.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+
+    // Starts a frame of itemCount items: last frame's queries become the draw conditions
+    void BeginFrame(size_t itemCount);
+
+    // Wrap the draws of one item; it is drawn unconditionally if it has no query yet
+    void BeginItem(size_t item);
+    void EndItem();
+
+    // Draws the boxes of the candidate items (model space, placed by model) into this
+    // frame's queries. boxShader is a position-only program with the uniforms of
+    // depthMap.vert; its lightSpaceTrMatrix is set to viewProjection, model has to be
+    // the one in the ObjectBlock the caller has bound.
+    void IssueQueries(gps::Shader& boxShader, const glm::mat4& viewProjection, const glm::mat4& model,
+        const std::vector<BoundingBox>& boxes, const std::vector<unsigned char>& candidates);
+
+    // Results of the queries that decided this frame's draws
+    const OcclusionStats& GetStats() const;
+
+private:
+    bool enabled;
+    // queries[frame parity][item]; issued tells whether the query holds a result to use
+    std::vector<GLuint> queries[2];
+    std::vector<unsigned char> issued[2];
+    int current;
+    bool conditionActive;
+    OcclusionStats stats;
+
+    // unit cube in the packed position format, scaled to each box by the dequantization
+    GLuint boxVAO;
+    GLuint boxVBO;
+    GLuint boxEBO;
+
+    void CreateBox();
+    void DeleteQueries();
+};
+
+}
+
+#endif /* OcclusionCuller_hpp */
@@ -0,0 +1,162 @@
+#include "ProgramCache.hpp"
+#include "Hash.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+	static const char PROGRAM_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'P' };
+	// Bump whenever the file layout changes
+	static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+	struct ProgramCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t binarySize;
+	};
+
+	static bool cacheEnabled = true;
+	// -1 until the driver was asked for its binary formats
+	static int driverSupport = -1;
+	static ProgramCacheStats stats = { 0, 0 };
+
+	static uint64_t HashString(const std::string& text, uint64_t hash)
+	{
+		// the length keeps "ab" + "c" apart from "a" + "bc"
+		uint64_t length = text.size();
+		hash = HashBytes(&length, sizeof(length), hash);
+		return HashBytes(text.data(), text.size(), hash);
+	}
+
+	static std::string GlString(GLenum name)
+	{
+		const GLubyte* text = glGetString(name);
+		return text ? std::string((const char*)text) : std::string();
+	}
+
+	uint64_t ProgramCache::Key(const std::string& vertexSource, const std::string& fragmentSource)
+	{
+		uint64_t hash = HashString(vertexSource, HASH_SEED);
+		hash = HashString(fragmentSource, hash);
+		hash = HashString(GlString(GL_VENDOR), hash);
+		hash = HashString(GlString(GL_RENDERER), hash);
+		return HashString(GlString(GL_VERSION), hash);
+	}
+
+	std::string ProgramCache::CachePath(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+		const std::vector<std::string>& defines)
+	{
+		uint64_t hash = HashString(vertexShaderFileName, HASH_SEED);
+		for (size_t i = 0; i < defines.size(); i++)
+			hash = HashString(defines[i], hash);
+
+		std::stringstream path;
+		path << fragmentShaderFileName << "." << std::hex << hash << ".programcache";
+		return path.str();
+	}
+
+	bool ProgramCache::Load(std::string path, uint64_t key, GLuint program)
+	{
+		if (!IsEnabled())
+			return false;
+
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+
+		ProgramCacheHeader header;
+		if (!file.read((char*)&header, sizeof(header)))
+			return false;
+		if (memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != PROGRAM_CACHE_VERSION || header.key != key || header.binarySize == 0)
+			return false;
+
+		std::vector<char> binary(header.binarySize);
+		if (!file.read(&binary[0], binary.size()))
+			return false;
+
+		// the driver may still refuse a binary it wrote, e.g. after a setting changed
+		glProgramBinary(program, (GLenum)header.binaryFormat, &binary[0], (GLsizei)binary.size());
+		GLint success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+			return false;
+
+		stats.loaded++;
+		return true;
+	}
+
+	bool ProgramCache::Save(std::string path, uint64_t key, GLuint program)
+	{
+		if (!IsEnabled())
+			return false;
+
+		GLint success, binarySize = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+		if (!success || binarySize <= 0)
+			return false;
+
+		std::vector<char> binary(binarySize);
+		GLenum binaryFormat;
+		GLsizei written = 0;
+		glGetProgramBinary(program, binarySize, &written, &binaryFormat, &binary[0]);
+		if (written <= 0)
+			return false;
+
+		ProgramCacheHeader header;
+		memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+		header.version = PROGRAM_CACHE_VERSION;
+		header.key = key;
+		header.binaryFormat = binaryFormat;
+		header.binarySize = (uint32_t)written;
+
+		std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cerr << "WARNING: could not write program cache " << path << std::endl;
+			return false;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write(&binary[0], written);
+		return file.good();
+	}
+
+	void ProgramCache::SetEnabled(bool enabled)
+	{
+		cacheEnabled = enabled;
+	}
+
+	bool ProgramCache::IsEnabled()
+	{
+		if (!cacheEnabled)
+			return false;
+		if (driverSupport < 0) {
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			driverSupport = formats > 0 ? 1 : 0;
+		}
+		return driverSupport == 1;
+	}
+
+	const ProgramCacheStats& ProgramCache::GetStats()
+	{
+		return stats;
+	}
+
+	void ProgramCache::ResetStats()
+	{
+		stats.loaded = 0;
+		stats.compiled = 0;
+	}
+
+	void ProgramCache::CountCompiled()
+	{
+		stats.compiled++;
+	}
+}
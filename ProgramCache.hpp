@@ -0,0 +1,55 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+// Programs linked and loaded since the last ResetProgramCacheStats
+struct ProgramCacheStats
+{
+    int loaded;
+    int compiled;
+};
+
+// Linked program binaries (glGetProgramBinary) stored next to the fragment shader, one
+// file per shader pair and define set. Each file records a key made of the shader sources
+// and the GL vendor, renderer and version strings; a file whose key no longer matches is
+// ignored and overwritten by the next link, so edits and driver updates invalidate it.
+class ProgramCache
+{
+public:
+    // Key of a program built from these (define injected) sources on the current driver
+    static uint64_t Key(const std::string& vertexSource, const std::string& fragmentSource);
+
+    // Name of the cached binary of one shader pair and define set
+    static std::string CachePath(std::string vertexShaderFileName, std::string fragmentShaderFileName,
+        const std::vector<std::string>& defines);
+
+    // Loads the binary stored under key into program; fails if it is missing, stale or the
+    // driver rejects it, and program is then left for a compile from source
+    static bool Load(std::string path, uint64_t key, GLuint program);
+
+    // Stores the binary of a program linked with the retrievable hint
+    static bool Save(std::string path, uint64_t key, GLuint program);
+
+    // Off skips the cache entirely; on by default when the driver has a binary format
+    static void SetEnabled(bool enabled);
+
+    static bool IsEnabled();
+
+    static const ProgramCacheStats& GetStats();
+
+    static void ResetStats();
+
+    // Counts a program that had to be compiled from source
+    static void CountCompiled();
+};
+
+}
+
+#endif /* ProgramCache_hpp */
@@ -0,0 +1,379 @@
+#include "SceneBvh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+namespace gps {
+
+	// bins per axis when searching for the cheapest split
+	static const int SAH_BIN_COUNT = 12;
+	// leaves never hold more items than this, even when splitting looks more expensive
+	static const uint32_t MAX_LEAF_ITEMS = 4;
+	// cost of visiting a node, relative to testing one item
+	static const float SAH_TRAVERSAL_COST = 1.0f;
+
+	static float SurfaceArea(const BoundingBox& box)
+	{
+		glm::vec3 extent = glm::max(box.maximum - box.minimum, glm::vec3(0.0f));
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	static BoundingBox EmptyBox()
+	{
+		BoundingBox box;
+		box.minimum = glm::vec3(std::numeric_limits<float>::max());
+		box.maximum = glm::vec3(-std::numeric_limits<float>::max());
+		return box;
+	}
+
+	static void GrowBox(BoundingBox& box, const BoundingBox& other)
+	{
+		box.minimum = glm::min(box.minimum, other.minimum);
+		box.maximum = glm::max(box.maximum, other.maximum);
+	}
+
+	SceneBvh::SceneBvh()
+	{
+
+	}
+
+	BoundingBox SceneBvh::ItemBounds(uint32_t firstItem, uint32_t itemCount) const
+	{
+		BoundingBox box = EmptyBox();
+		for (uint32_t i = firstItem; i < firstItem + itemCount; i++)
+			GrowBox(box, itemBoxes[itemOrder[i]]);
+		return box;
+	}
+
+	void SceneBvh::Build(const std::vector<BoundingBox>& boxes)
+	{
+		itemBoxes = boxes;
+		itemOrder.resize(boxes.size());
+		std::vector<glm::vec3> centroids(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++) {
+			itemOrder[i] = (uint32_t)i;
+			centroids[i] = (boxes[i].minimum + boxes[i].maximum) * 0.5f;
+		}
+
+		nodes.clear();
+		if (boxes.empty())
+			return;
+		// a binary tree with n leaves has 2n - 1 nodes
+		nodes.reserve(boxes.size() * 2);
+
+		Node root;
+		root.firstItem = 0;
+		root.itemCount = (uint32_t)boxes.size();
+		root.left = 0;
+		root.box = ItemBounds(0, root.itemCount);
+		nodes.push_back(root);
+		Subdivide(0, centroids);
+	}
+
+	void SceneBvh::Subdivide(uint32_t nodeIndex, const std::vector<glm::vec3>& centroids)
+	{
+		// copies - nodes may reallocate while the children are added
+		uint32_t firstItem = nodes[nodeIndex].firstItem;
+		uint32_t itemCount = nodes[nodeIndex].itemCount;
+		if (itemCount <= 1)
+			return;
+
+		BoundingBox centroidBounds = EmptyBox();
+		for (uint32_t i = firstItem; i < firstItem + itemCount; i++) {
+			centroidBounds.minimum = glm::min(centroidBounds.minimum, centroids[itemOrder[i]]);
+			centroidBounds.maximum = glm::max(centroidBounds.maximum, centroids[itemOrder[i]]);
+		}
+
+		// binned SAH: cost of a split is area(left) * count(left) + area(right) * count(right)
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1, bestSplit = 0;
+		BoundingBox bestLeftBox, bestRightBox;
+		for (int axis = 0; axis < 3; axis++) {
+			float axisMinimum = centroidBounds.minimum[axis];
+			float axisExtent = centroidBounds.maximum[axis] - axisMinimum;
+			if (axisExtent <= 0.0f)
+				continue;
+
+			BoundingBox binBoxes[SAH_BIN_COUNT];
+			uint32_t binCounts[SAH_BIN_COUNT] = { 0 };
+			for (int b = 0; b < SAH_BIN_COUNT; b++)
+				binBoxes[b] = EmptyBox();
+			for (uint32_t i = firstItem; i < firstItem + itemCount; i++) {
+				uint32_t item = itemOrder[i];
+				int bin = std::min(SAH_BIN_COUNT - 1, (int)((centroids[item][axis] - axisMinimum) / axisExtent * SAH_BIN_COUNT));
+				binCounts[bin]++;
+				GrowBox(binBoxes[bin], itemBoxes[item]);
+			}
+
+			// sweep from the right to get the right hand side of every split plane
+			BoundingBox rightBoxes[SAH_BIN_COUNT];
+			uint32_t rightCounts[SAH_BIN_COUNT];
+			BoundingBox rightBox = EmptyBox();
+			uint32_t rightCount = 0;
+			for (int b = SAH_BIN_COUNT - 1; b > 0; b--) {
+				GrowBox(rightBox, binBoxes[b]);
+				rightCount += binCounts[b];
+				rightBoxes[b] = rightBox;
+				rightCounts[b] = rightCount;
+			}
+
+			BoundingBox leftBox = EmptyBox();
+			uint32_t leftCount = 0;
+			for (int split = 1; split < SAH_BIN_COUNT; split++) {
+				GrowBox(leftBox, binBoxes[split - 1]);
+				leftCount += binCounts[split - 1];
+				if (leftCount == 0 || rightCounts[split] == 0)
+					continue;
+
+				float cost = SurfaceArea(leftBox) * leftCount + SurfaceArea(rightBoxes[split]) * rightCounts[split];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+					bestLeftBox = leftBox;
+					bestRightBox = rightBoxes[split];
+				}
+			}
+		}
+
+		// keeping the node as a leaf costs testing every item, splitting adds a node visit
+		float nodeArea = SurfaceArea(nodes[nodeIndex].box);
+		float leafCost = nodeArea * itemCount;
+		bestCost += SAH_TRAVERSAL_COST * nodeArea;
+		if (bestAxis < 0 || (bestCost >= leafCost && itemCount <= MAX_LEAF_ITEMS))
+			return;
+
+		float axisMinimum = centroidBounds.minimum[bestAxis];
+		float axisExtent = centroidBounds.maximum[bestAxis] - axisMinimum;
+		uint32_t* begin = &itemOrder[firstItem];
+		uint32_t* middle = std::partition(begin, begin + itemCount, [&](uint32_t item) {
+			int bin = std::min(SAH_BIN_COUNT - 1, (int)((centroids[item][bestAxis] - axisMinimum) / axisExtent * SAH_BIN_COUNT));
+			return bin < bestSplit;
+		});
+		uint32_t leftCount = (uint32_t)(middle - begin);
+
+		Node left, right;
+		left.firstItem = firstItem;
+		left.itemCount = leftCount;
+		left.left = 0;
+		// the bins already hold the bounds of both sides
+		left.box = bestLeftBox;
+		right.firstItem = firstItem + leftCount;
+		right.itemCount = itemCount - leftCount;
+		right.left = 0;
+		right.box = bestRightBox;
+
+		uint32_t leftIndex = (uint32_t)nodes.size();
+		nodes[nodeIndex].left = leftIndex;
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		Subdivide(leftIndex, centroids);
+		Subdivide(leftIndex + 1, centroids);
+	}
+
+	void SceneBvh::SetItemBox(size_t item, const BoundingBox& box)
+	{
+		itemBoxes[item] = box;
+	}
+
+	void SceneBvh::Refit()
+	{
+		// children are always stored after their parent
+		for (size_t n = nodes.size(); n-- > 0;) {
+			Node& node = nodes[n];
+			if (node.left == 0) {
+				node.box = ItemBounds(node.firstItem, node.itemCount);
+			}
+			else {
+				node.box = nodes[node.left].box;
+				GrowBox(node.box, nodes[node.left + 1].box);
+			}
+		}
+	}
+
+	void SceneBvh::QueryFrustum(const Frustum& frustum, std::vector<unsigned char>& visible) const
+	{
+		visible.assign(itemBoxes.size(), 0);
+		if (nodes.empty())
+			return;
+
+		size_t nodesVisited = 0, itemsTested = 0;
+		uint32_t stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0) {
+			const Node& node = nodes[stack[--stackSize]];
+			nodesVisited++;
+
+			FrustumTest test = frustum.Classify(node.box);
+			if (test == FRUSTUM_OUTSIDE)
+				continue;
+
+			if (test == FRUSTUM_INSIDE) {
+				for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; i++)
+					visible[itemOrder[i]] = 1;
+				continue;
+			}
+
+			if (node.left == 0) {
+				for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; i++) {
+					itemsTested++;
+					if (frustum.Intersects(itemBoxes[itemOrder[i]]))
+						visible[itemOrder[i]] = 1;
+				}
+				continue;
+			}
+
+			// a SAH tree over a scene stays far below 32 levels; fall back to testing the items
+			if (stackSize + 2 > 64) {
+				for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; i++)
+					visible[itemOrder[i]] = frustum.Intersects(itemBoxes[itemOrder[i]]) ? 1 : 0;
+				continue;
+			}
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.left + 1;
+		}
+
+		size_t culled = 0;
+		for (size_t i = 0; i < visible.size(); i++)
+			culled += visible[i] ? 0 : 1;
+		RecordCulling(visible.size(), culled, nodesVisited);
+	}
+
+	// Distance along the ray to where it enters the box, or a negative value on a miss
+	static float RayBoxDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const BoundingBox& box)
+	{
+		glm::vec3 t0 = (box.minimum - origin) * inverseDirection;
+		glm::vec3 t1 = (box.maximum - origin) * inverseDirection;
+		glm::vec3 nearest = glm::min(t0, t1), farthest = glm::max(t0, t1);
+		float enter = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+		float exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+		return enter <= exit ? enter : -1.0f;
+	}
+
+	bool SceneBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, size_t& item, float& distance) const
+	{
+		if (nodes.empty())
+			return false;
+
+		// divisions by zero give infinities, which the slab test handles
+		glm::vec3 inverseDirection = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		float closest = maxDistance;
+		bool hit = false;
+
+		uint32_t stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const Node& node = nodes[stack[--stackSize]];
+			float nodeDistance = RayBoxDistance(origin, inverseDirection, closest, node.box);
+			if (nodeDistance < 0.0f)
+				continue;
+
+			if (node.left == 0 || stackSize + 2 > 64) {
+				for (uint32_t i = node.firstItem; i < node.firstItem + node.itemCount; i++) {
+					float itemDistance = RayBoxDistance(origin, inverseDirection, closest, itemBoxes[itemOrder[i]]);
+					if (itemDistance >= 0.0f && itemDistance <= closest) {
+						closest = itemDistance;
+						item = itemOrder[i];
+						hit = true;
+					}
+				}
+				continue;
+			}
+
+			// visit the nearer child first, so the farther one is more likely to be pruned
+			float leftDistance = RayBoxDistance(origin, inverseDirection, closest, nodes[node.left].box);
+			float rightDistance = RayBoxDistance(origin, inverseDirection, closest, nodes[node.left + 1].box);
+			bool leftFirst = rightDistance < 0.0f || (leftDistance >= 0.0f && leftDistance <= rightDistance);
+			stack[stackSize++] = leftFirst ? node.left + 1 : node.left;
+			stack[stackSize++] = leftFirst ? node.left : node.left + 1;
+		}
+
+		if (hit)
+			distance = closest;
+		return hit;
+	}
+
+	size_t SceneBvh::GetItemCount() const
+	{
+		return itemBoxes.size();
+	}
+
+	size_t SceneBvh::GetNodeCount() const
+	{
+		return nodes.size();
+	}
+
+	void SceneBvh::Benchmark(size_t itemCount)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+
+		// small boxes scattered over a 200 unit square, like props on a terrain
+		srand(1234);
+		std::vector<BoundingBox> boxes(itemCount);
+		for (size_t i = 0; i < itemCount; i++) {
+			glm::vec3 center((rand() % 20000) / 100.0f - 100.0f, (rand() % 1000) / 100.0f, (rand() % 20000) / 100.0f - 100.0f);
+			glm::vec3 extent(0.2f + (rand() % 100) / 100.0f);
+			boxes[i].minimum = center - extent;
+			boxes[i].maximum = center + extent;
+		}
+
+		SceneBvh bvh;
+		Clock::time_point start = Clock::now();
+		bvh.Build(boxes);
+		double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		start = Clock::now();
+		bvh.Refit();
+		double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		// a camera turning around the middle of the scene, looking slightly down
+		const int queryCount = 256;
+		ResetCullingStats();
+		std::vector<unsigned char> visible;
+		start = Clock::now();
+		for (int q = 0; q < queryCount; q++) {
+			float angle = q * 6.2831853f / queryCount;
+			glm::vec3 forward(std::cos(angle), -0.2f, std::sin(angle));
+			glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+			glm::vec3 up = glm::cross(right, forward);
+			glm::vec3 eye(0.0f, 5.0f, 0.0f);
+			// a 90 degree view with near 0.1 and far 100, built from its planes directly
+			Frustum frustum;
+			frustum.planeCount = 6;
+			frustum.planes[0] = glm::vec4(glm::normalize(forward + right), -glm::dot(glm::normalize(forward + right), eye));
+			frustum.planes[1] = glm::vec4(glm::normalize(forward - right), -glm::dot(glm::normalize(forward - right), eye));
+			frustum.planes[2] = glm::vec4(glm::normalize(forward + up), -glm::dot(glm::normalize(forward + up), eye));
+			frustum.planes[3] = glm::vec4(glm::normalize(forward - up), -glm::dot(glm::normalize(forward - up), eye));
+			frustum.planes[4] = glm::vec4(forward, -glm::dot(forward, eye) - 0.1f);
+			frustum.planes[5] = glm::vec4(-forward, glm::dot(forward, eye) + 100.0f);
+			bvh.QueryFrustum(frustum, visible);
+		}
+		double queryMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / queryCount;
+		CullingStats stats = GetCullingStats();
+
+		const int rayCount = 10000;
+		size_t hits = 0;
+		start = Clock::now();
+		for (int r = 0; r < rayCount; r++) {
+			glm::vec3 origin((rand() % 20000) / 100.0f - 100.0f, 20.0f, (rand() % 20000) / 100.0f - 100.0f);
+			size_t item;
+			float distance;
+			hits += bvh.Raycast(origin, glm::vec3(0.3f, -1.0f, 0.1f), 100.0f, item, distance) ? 1 : 0;
+		}
+		double rayUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / rayCount;
+
+		std::cout << "BVH benchmark : " << itemCount << " items, " << bvh.GetNodeCount() << " nodes" << std::endl
+			<< "  build " << buildMs << " ms, refit " << refitMs << " ms" << std::endl
+			<< "  frustum query " << queryMs << " ms, " << stats.nodesVisited / queryCount << " nodes visited, "
+			<< (stats.tested - stats.culled) / queryCount << " visible" << std::endl
+			<< "  raycast " << rayUs << " us, " << hits << " of " << rayCount << " hit" << std::endl;
+	}
+}
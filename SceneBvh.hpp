@@ -0,0 +1,64 @@
+#ifndef SceneBvh_hpp
+#define SceneBvh_hpp
+
+#include "Frustum.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+// Bounding volume hierarchy over a set of boxes, built with the surface area heuristic.
+// Items are referred to by their index in the vector given to Build. Moving items are
+// handled by SetItemBox + Refit, which keep the tree and only grow/shrink its boxes.
+class SceneBvh
+{
+public:
+    SceneBvh();
+
+    // Rebuilds the tree over itemBoxes
+    void Build(const std::vector<BoundingBox>& itemBoxes);
+
+    // Changes the box of one item; the tree is stale until Refit
+    void SetItemBox(size_t item, const BoundingBox& box);
+
+    // Recomputes every node box from the item boxes, bottom-up
+    void Refit();
+
+    // Sets visible[item] for every item (resizing it to GetItemCount()). Subtrees fully
+    // inside the frustum are accepted without testing their items. Updates the culling
+    // statistics, including the nodes visited.
+    void QueryFrustum(const Frustum& frustum, std::vector<unsigned char>& visible) const;
+
+    // Nearest item whose box the ray hits within maxDistance; direction need not be normalized,
+    // distance is in units of its length
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, size_t& item, float& distance) const;
+
+    size_t GetItemCount() const;
+    size_t GetNodeCount() const;
+
+    // Prints build and query timings over itemCount random boxes
+    static void Benchmark(size_t itemCount);
+
+private:
+    struct Node
+    {
+        BoundingBox box;
+        // items of the whole subtree are itemOrder[firstItem, firstItem + itemCount)
+        uint32_t firstItem;
+        uint32_t itemCount;
+        // the right child is left + 1; 0 for leaves, since the root is never a child
+        uint32_t left;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> itemOrder;
+    std::vector<BoundingBox> itemBoxes;
+
+    void Subdivide(uint32_t nodeIndex, const std::vector<glm::vec3>& centroids);
+    BoundingBox ItemBounds(uint32_t firstItem, uint32_t itemCount) const;
+};
+
+}
+
+#endif /* SceneBvh_hpp */
@@ -1,4 +1,9 @@
 #include "Shader.hpp"
+#include "ProgramCache.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 namespace gps {
     std::string Shader::readShaderFile(std::string fileName)
@@ -22,6 +27,28 @@ namespace gps {
         return shaderString;
     }
 
+    std::string Shader::injectDefines(const std::string& source, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+            return source;
+
+        //#version has to stay the first statement, the defines go right after it
+        size_t insertAt = 0;
+        if (source.compare(0, 8, "#version") == 0) {
+            insertAt = source.find('\n');
+            insertAt = insertAt == std::string::npos ? source.size() : insertAt + 1;
+        }
+
+        std::string block;
+        for (size_t i = 0; i < defines.size(); i++)
+            block += "#define " + defines[i] + " 1\n";
+        //keep the line numbers of compile errors pointing at the file
+        if (insertAt > 0)
+            block += "#line 2\n";
+
+        return source.substr(0, insertAt) + block + source.substr(insertAt);
+    }
+
     void Shader::shaderCompileLog(GLuint shaderId)
     {
         GLint success;
@@ -49,42 +76,382 @@ namespace gps {
         }
     }
 
+    bool Shader::parallelCompile = false;
+    GLuint Shader::activeProgram = 0;
+    UniformStats Shader::uniformStats = { 0, 0 };
+
+    //names behind the uniform ids - function statics, ids are taken during static initialization
+    static std::vector<std::string>& UniformNames()
+    {
+        static std::vector<std::string> names;
+        return names;
+    }
+
+    static std::unordered_map<std::string, UniformId>& UniformIds()
+    {
+        static std::unordered_map<std::string, UniformId> ids;
+        return ids;
+    }
+
+    static std::unordered_map<std::string, GLuint>& UniformBlockBindings()
+    {
+        static std::unordered_map<std::string, GLuint> bindings;
+        return bindings;
+    }
+
+    Shader::Shader()
+    {
+        this->shaderProgram = 0;
+        this->pending = false;
+        this->vertexShader = 0;
+        this->fragmentShader = 0;
+        this->cacheKey = 0;
+    }
+
+    bool Shader::initParallelCompile()
+    {
+        //let the driver pick the number of compiler threads
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+        else if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+        return parallelCompile;
+    }
+
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
+        loadShader(vertexShaderFileName, fragmentShaderFileName, std::vector<std::string>());
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::vector<std::string>& defines)
+    {
+        beginLoad(vertexShaderFileName, fragmentShaderFileName, defines);
+        finishLoad();
+    }
+
+    void Shader::beginLoad(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::vector<std::string>& defines)
+    {
+        std::string v = injectDefines(readShaderFile(vertexShaderFileName), defines);
+        std::string f = injectDefines(readShaderFile(fragmentShaderFileName), defines);
+
+        //loading again replaces the program of the earlier load
+        deleteProgram();
+
+        //a binary linked on an earlier run skips the compile altogether
+        this->shaderProgram = glCreateProgram();
+        this->activeUniforms.clear();
+        this->uniforms.clear();
+        this->cacheKey = ProgramCache::Key(v, f);
+        this->cachePath = ProgramCache::CachePath(vertexShaderFileName, fragmentShaderFileName, defines);
+        if (ProgramCache::Load(this->cachePath, this->cacheKey, this->shaderProgram)) {
+            reflectUniforms();
+            return;
+        }
+
+        //compile the vertex shader
         const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        this->vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(this->vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(this->vertexShader);
+
+        //compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
-
-        //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
+        this->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(this->fragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(this->fragmentShader);
+
+        //attach and link the shader programs; the status is only asked for in finishLoad,
+        //asking now would make the driver finish the job before the next one is issued
+        glAttachShader(this->shaderProgram, this->vertexShader);
+        glAttachShader(this->shaderProgram, this->fragmentShader);
+        glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
+        this->pending = true;
+    }
+
+    void Shader::deleteProgram()
+    {
+        //shaders of a load finishLoad never saw
+        if (this->pending) {
+            glDeleteShader(this->vertexShader);
+            glDeleteShader(this->fragmentShader);
+            this->vertexShader = 0;
+            this->fragmentShader = 0;
+            this->pending = false;
+        }
+
+        if (this->shaderProgram) {
+            glDeleteProgram(this->shaderProgram);
+            //the name of a deleted program can come back
+            if (activeProgram == this->shaderProgram)
+                activeProgram = 0;
+            this->shaderProgram = 0;
+        }
+    }
+
+    bool Shader::isReady()
+    {
+        if (!this->pending)
+            return true;
+
+        if (parallelCompile) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(this->shaderProgram, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done)
+                return false;
+        }
+
+        finishLoad();
+        return true;
+    }
+
+    void Shader::finishLoad()
+    {
+        if (!this->pending)
+            return;
+        this->pending = false;
+
+        //check compilation and linking status
+        shaderCompileLog(this->vertexShader);
+        shaderCompileLog(this->fragmentShader);
+        glDeleteShader(this->vertexShader);
+        glDeleteShader(this->fragmentShader);
+        this->vertexShader = 0;
+        this->fragmentShader = 0;
         shaderLinkLog(this->shaderProgram);
+        reflectUniforms();
+
+        ProgramCache::CountCompiled();
+        ProgramCache::Save(this->cachePath, this->cacheKey, this->shaderProgram);
     }
 
     void Shader::useShaderProgram()
     {
+        if (activeProgram == this->shaderProgram)
+            return;
         glUseProgram(this->shaderProgram);
+        activeProgram = this->shaderProgram;
+    }
+
+    void Shader::reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniformName(&name[0], length);
+            //arrays are listed as name[0], they are set from their first element
+            size_t bracket = uniformName.find('[');
+            if (bracket != std::string::npos)
+                uniformName.resize(bracket);
+            //uniforms in blocks have no location
+            GLint location = glGetUniformLocation(this->shaderProgram, uniformName.c_str());
+            if (location >= 0)
+                this->activeUniforms[uniformName] = location;
+        }
+
+        //GLSL 4.10 cannot give a block its binding, it is set here
+        GLint blockCount = 0, maxBlockLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockLength);
+        std::vector<GLchar> blockName(std::max(maxBlockLength, 1));
+        const std::unordered_map<std::string, GLuint>& bindings = UniformBlockBindings();
+        for (GLint i = 0; i < blockCount; i++) {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(this->shaderProgram, (GLuint)i, (GLsizei)blockName.size(), &length, &blockName[0]);
+            auto found = bindings.find(std::string(&blockName[0], length));
+            if (found != bindings.end())
+                glUniformBlockBinding(this->shaderProgram, (GLuint)i, found->second);
+        }
+    }
+
+    void Shader::bindUniformBlock(const std::string& blockName, GLuint binding)
+    {
+        UniformBlockBindings()[blockName] = binding;
+    }
+
+    UniformId Shader::uniformId(const std::string& name)
+    {
+        std::unordered_map<std::string, UniformId>& ids = UniformIds();
+        auto found = ids.find(name);
+        if (found != ids.end())
+            return found->second;
+
+        UniformId id = (UniformId)UniformNames().size();
+        UniformNames().push_back(name);
+        ids[name] = id;
+        return id;
+    }
+
+    GLint Shader::getUniformLocation(UniformId id)
+    {
+        const std::vector<std::string>& names = UniformNames();
+        if (id < 0 || (size_t)id >= names.size())
+            return -1;
+
+        //ids taken since the last lookup
+        if ((size_t)id >= this->uniforms.size()) {
+            size_t first = this->uniforms.size();
+            this->uniforms.resize(names.size());
+            for (size_t i = first; i < names.size(); i++) {
+                auto found = this->activeUniforms.find(names[i]);
+                this->uniforms[i].location = found != this->activeUniforms.end() ? found->second : -1;
+            }
+        }
+        return this->uniforms[id].location;
+    }
+
+    Shader::UniformSlot* Shader::changedSlot(UniformId id, const void* value, size_t size)
+    {
+        if (getUniformLocation(id) < 0)
+            return NULL;
+
+        UniformSlot& slot = this->uniforms[id];
+        if (slot.value.size() == size && memcmp(&slot.value[0], value, size) == 0) {
+            uniformStats.skipped++;
+            return NULL;
+        }
+        const unsigned char* bytes = (const unsigned char*)value;
+        slot.value.assign(bytes, bytes + size);
+        uniformStats.uploaded++;
+        return &slot;
+    }
+
+    const UniformStats& Shader::getUniformStats()
+    {
+        return uniformStats;
+    }
+
+    void Shader::resetUniformStats()
+    {
+        uniformStats.uploaded = 0;
+        uniformStats.skipped = 0;
+    }
+
+    void Shader::setUniform(UniformId id, GLint value)
+    {
+        if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+            glProgramUniform1i(this->shaderProgram, slot->location, value);
+    }
+
+    void Shader::setUniform(UniformId id, GLfloat value)
+    {
+        if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+            glProgramUniform1f(this->shaderProgram, slot->location, value);
+    }
+
+    void Shader::setUniform(UniformId id, const glm::vec2& value)
+    {
+        if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+            glProgramUniform2fv(this->shaderProgram, slot->location, 1, glm::value_ptr(value));
+    }
+
+    void Shader::setUniform(UniformId id, const glm::vec3& value)
+    {
+        if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+            glProgramUniform3fv(this->shaderProgram, slot->location, 1, glm::value_ptr(value));
+    }
+
+    void Shader::setUniform(UniformId id, const glm::mat3& value)
+    {
+        if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+            glProgramUniformMatrix3fv(this->shaderProgram, slot->location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void Shader::setUniform(UniformId id, const glm::mat4& value)
+    {
+        if (UniformSlot* slot = changedSlot(id, &value, sizeof(value)))
+            glProgramUniformMatrix4fv(this->shaderProgram, slot->location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void Shader::setUniformArray(UniformId id, const GLint* values, GLsizei count)
+    {
+        if (count <= 0)
+            return;
+        if (UniformSlot* slot = changedSlot(id, values, count * sizeof(GLint)))
+            glProgramUniform1iv(this->shaderProgram, slot->location, count, values);
+    }
+
+    void Shader::setUniformArray(UniformId id, const GLfloat* values, GLsizei count)
+    {
+        if (count <= 0)
+            return;
+        if (UniformSlot* slot = changedSlot(id, values, count * sizeof(GLfloat)))
+            glProgramUniform1fv(this->shaderProgram, slot->location, count, values);
+    }
+
+    void Shader::setUniformArray(UniformId id, const glm::mat4* values, GLsizei count)
+    {
+        if (count <= 0)
+            return;
+        if (UniformSlot* slot = changedSlot(id, values, count * sizeof(glm::mat4)))
+            glProgramUniformMatrix4fv(this->shaderProgram, slot->location, count, GL_FALSE, glm::value_ptr(values[0]));
+    }
+
+    void ShaderVariants::Load(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> features)
+    {
+        this->vertexShaderFileName = vertexShaderFileName;
+        this->fragmentShaderFileName = fragmentShaderFileName;
+        this->features = features;
+        this->features.resize(std::min(this->features.size(), (size_t)32));
+        for (auto& variant : variants)
+            variant.second.deleteProgram();
+        variants.clear();
+    }
+
+    Shader& ShaderVariants::BeginLoad(ShaderVariantKey key)
+    {
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return found->second;
+
+        std::vector<std::string> defines;
+        for (size_t i = 0; i < features.size(); i++) {
+            if (key & (1u << i))
+                defines.push_back(features[i]);
+        }
+
+        Shader& shader = variants[key];
+        shader.beginLoad(vertexShaderFileName, fragmentShaderFileName, defines);
+        return shader;
+    }
+
+    Shader& ShaderVariants::Get(ShaderVariantKey key)
+    {
+        Shader& shader = BeginLoad(key);
+        shader.finishLoad();
+        return shader;
+    }
+
+    Shader& ShaderVariants::GetReady(ShaderVariantKey key, Shader& placeholder)
+    {
+        Shader& shader = BeginLoad(key);
+        return shader.isReady() ? shader : placeholder;
+    }
+
+    size_t ShaderVariants::GetCompiledCount() const
+    {
+        return variants.size();
+    }
+
+    size_t ShaderVariants::GetPendingCount()
+    {
+        size_t pendingCount = 0;
+        for (auto& variant : variants) {
+            if (!variant.second.isReady())
+                pendingCount++;
+        }
+        return pendingCount;
     }
 
 }
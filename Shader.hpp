@@ -2,28 +2,152 @@
 #define Shader_hpp
 
 #include <GL/glew.h>
+#include "glm/glm.hpp"
 
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace gps {
 
+// Index of a uniform name in the location table of every Shader - get it once with
+// Shader::uniformId and pass it to the setters instead of the name
+typedef int UniformId;
+
+// Uniform setter calls since the last Shader::resetUniformStats
+struct UniformStats
+{
+    long uploaded;
+    // same value as the program already held
+    long skipped;
+};
+
+// One program. Its active uniforms are reflected when it links; the setters go through that
+// table and skip uploads of the value the program already holds. Not copyable, the table
+// has to follow the program - pass it by reference.
 class Shader
 {
 public:
     GLuint shaderProgram;
+    Shader();
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    // Links from the ProgramCache binary when a valid one exists, else compiles and stores one
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+    // Same, with "#define <name> 1" inserted after the #version line of both shaders
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::vector<std::string>& defines);
+    // loadShader in two halves: beginLoad issues the compile and link without waiting for
+    // them, so several programs build at once; finishLoad waits and reports errors
+    void beginLoad(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::vector<std::string>& defines);
+    void finishLoad();
+    // Whether the program is linked and can be drawn with. Never waits when the driver has
+    // parallel shader compile, without it the first call finishes the load.
+    bool isReady();
+    // Skips the glUseProgram when the program is already in use
     void useShaderProgram();
+    // Deletes the program, and the shaders of a load that was not finished
+    void deleteProgram();
+
+    // Makes every program that declares the uniform block blockName read it from a binding
+    // point (see UniformBuffer) - register the blocks before loading the programs
+    static void bindUniformBlock(const std::string& blockName, GLuint binding);
+
+    // Id of a uniform name, the same for every program; array uniforms go by their plain name
+    static UniformId uniformId(const std::string& name);
+
+    // -1 when the uniform is not active in this program
+    GLint getUniformLocation(UniformId id);
+
+    // Typed setters, the program does not have to be in use
+    void setUniform(UniformId id, GLint value);
+    void setUniform(UniformId id, GLfloat value);
+    void setUniform(UniformId id, const glm::vec2& value);
+    void setUniform(UniformId id, const glm::vec3& value);
+    void setUniform(UniformId id, const glm::mat3& value);
+    void setUniform(UniformId id, const glm::mat4& value);
+    void setUniformArray(UniformId id, const GLint* values, GLsizei count);
+    void setUniformArray(UniformId id, const GLfloat* values, GLsizei count);
+    void setUniformArray(UniformId id, const glm::mat4* values, GLsizei count);
+
+    static const UniformStats& getUniformStats();
+    static void resetUniformStats();
+
+    // Hands the compiles to driver threads (KHR/ARB_parallel_shader_compile) when there are
+    // any - call once after glewInit; returns whether the driver supports it
+    static bool initParallelCompile();
 
 private:
+    // load issued by beginLoad, not finished yet
+    bool pending;
+    GLuint vertexShader;
+    GLuint fragmentShader;
+    uint64_t cacheKey;
+    std::string cachePath;
+
+    static bool parallelCompile;
+    static GLuint activeProgram;
+    static UniformStats uniformStats;
+
+    // Location and last uploaded bytes of one uniform id
+    struct UniformSlot
+    {
+        GLint location;
+        std::vector<unsigned char> value;
+    };
+    // name to location of every active uniform, filled when the program links
+    std::unordered_map<std::string, GLint> activeUniforms;
+    // indexed by UniformId, resolved from activeUniforms as ids get used
+    std::vector<UniformSlot> uniforms;
+
+    // Fills the location table and connects the uniform blocks to their binding points
+    void reflectUniforms();
+    // Slot of id if the uniform is active and value differs from what was uploaded last
+    UniformSlot* changedSlot(UniformId id, const void* value, size_t size);
+
     std::string readShaderFile(std::string fileName);
+    static std::string injectDefines(const std::string& source, const std::vector<std::string>& defines);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
 };
 
+// Bit i set means the i-th feature of a ShaderVariants is on
+typedef uint32_t ShaderVariantKey;
+
+// Specialized programs built from one pair of shader files: every feature is a #define
+// the shaders test with #ifdef, so a variant only contains the code it uses. Each variant
+// is built the first time it is asked for and kept.
+class ShaderVariants
+{
+public:
+    // At most 32 features, in key bit order
+    void Load(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> features);
+
+    // Starts building the variant of key (see Shader::beginLoad), once
+    Shader& BeginLoad(ShaderVariantKey key);
+
+    // Program with the features of key switched on, waits for it to be built
+    Shader& Get(ShaderVariantKey key);
+
+    // Same without waiting - placeholder stands in until the variant is ready
+    Shader& GetReady(ShaderVariantKey key, Shader& placeholder);
+
+    size_t GetCompiledCount() const;
+
+    // Variants still being built
+    size_t GetPendingCount();
+
+private:
+    std::string vertexShaderFileName;
+    std::string fragmentShaderFileName;
+    std::vector<std::string> features;
+    std::unordered_map<ShaderVariantKey, Shader> variants;
+};
+
 }
 
 #endif /* Shader_hpp */
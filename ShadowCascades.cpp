@@ -0,0 +1,399 @@
+#include "ShadowCascades.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	// blend between logarithmic (1) and uniform (0) split distances
+	static const float CASCADE_SPLIT_LAMBDA = 0.75f;
+	// extra room around the static box, so walking does not move it every frame
+	static const float STATIC_BOX_MARGIN = 0.1f;
+	// side of a static texture at most this times the cascade's, which bounds its memory and
+	// the cost of redrawing it
+	static const float STATIC_BOX_MAX_SCALE = 1.5f;
+	// the nearest cascade is small and moves with every step - it is always drawn in full
+	static const int FIRST_STATIC_CASCADE = 1;
+
+	static const UniformId STATIC_DEPTH_UNIFORM = Shader::uniformId("staticDepth");
+	static const UniformId STATIC_TEXEL_OFFSET_UNIFORM = Shader::uniformId("staticTexelOffset");
+	static const UniformId STATIC_DEPTH_REMAP_UNIFORM = Shader::uniformId("staticDepthRemap");
+
+	ShadowCascades::ShadowCascades()
+	{
+		shadowDistance = 0.0f;
+		casterDistance = 0.0f;
+		staticCaching = false;
+		copyVAO = 0;
+	}
+
+	ShadowCascades::~ShadowCascades()
+	{
+		Delete();
+	}
+
+	void ShadowCascades::Delete()
+	{
+		DeleteStaticCache();
+		for (size_t i = 0; i < cascades.size(); i++) {
+			glDeleteFramebuffers(1, &cascades[i].framebuffer);
+			glDeleteTextures(1, &cascades[i].depthTexture);
+		}
+		cascades.clear();
+	}
+
+	void ShadowCascades::CreateDepthTarget(GLsizei resolution, GLuint& framebuffer, GLuint& depthTexture)
+	{
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, resolution, resolution, 0,
+			GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void ShadowCascades::DeleteStaticCache()
+	{
+		for (size_t i = 0; i < cascades.size(); i++) {
+			glDeleteFramebuffers(1, &cascades[i].staticFramebuffer);
+			glDeleteTextures(1, &cascades[i].staticDepthTexture);
+			cascades[i].staticFramebuffer = 0;
+			cascades[i].staticDepthTexture = 0;
+			cascades[i].staticResolution = 0;
+			cascades[i].staticValid = false;
+		}
+		glDeleteVertexArrays(1, &copyVAO);
+		copyVAO = 0;
+	}
+
+	void ShadowCascades::Create(const std::vector<GLsizei>& resolutions, float shadowDistance, float casterDistance)
+	{
+		Delete();
+		this->shadowDistance = shadowDistance;
+		this->casterDistance = casterDistance;
+
+		size_t count = std::min(resolutions.size(), (size_t)MAX_SHADOW_CASCADES);
+		for (size_t i = 0; i < count; i++) {
+			Cascade cascade;
+			cascade.resolution = resolutions[i];
+			cascade.lightSpaceMatrix = glm::mat4(1.0f);
+			cascade.casterFrustum = Frustum::Everything();
+			cascade.splitDistance = shadowDistance;
+			cascade.width = 1.0f;
+			cascade.depthBias = 0.0f;
+
+			cascade.staticFramebuffer = 0;
+			cascade.staticDepthTexture = 0;
+			cascade.staticResolution = 0;
+			cascade.staticValid = false;
+			cascade.staticTexelSize = 0.0f;
+			cascade.staticOriginX = 0;
+			cascade.staticOriginY = 0;
+			cascade.staticNear = 0.0f;
+			cascade.staticFar = 1.0f;
+			cascade.staticTexelOffset = glm::vec2(0.0f);
+			cascade.staticDepthRemap = glm::vec2(1.0f, 0.0f);
+			CreateDepthTarget(cascade.resolution, cascade.framebuffer, cascade.depthTexture);
+
+			cascades.push_back(cascade);
+		}
+
+		if (staticCaching) {
+			staticCaching = false;
+			SetStaticCaching(true);
+		}
+	}
+
+	void ShadowCascades::Update(const glm::mat4& cameraView, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection)
+	{
+		if (cascades.empty())
+			return;
+
+		glm::mat4 cameraToWorld = glm::inverse(cameraView);
+		glm::vec3 eye = glm::vec3(cameraToWorld[3]);
+		float tanHalfY = std::tan(fovY * 0.5f);
+		float tanHalfX = tanHalfY * aspect;
+
+		// fixed light orientation, so the texel grid only ever slides along x/y
+		glm::vec3 towardLight = glm::normalize(lightDirection);
+		glm::vec3 up = std::fabs(towardLight.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), -towardLight, up);
+		glm::vec3 lightEye = glm::vec3(lightView * glm::vec4(eye, 1.0f));
+
+		float sliceNear = nearPlane;
+		int count = (int)cascades.size();
+		for (int i = 0; i < count; i++) {
+			Cascade& cascade = cascades[i];
+
+			// practical split scheme
+			float fraction = (float)(i + 1) / count;
+			float logarithmic = nearPlane * std::pow(shadowDistance / nearPlane, fraction);
+			float uniform = nearPlane + (shadowDistance - nearPlane) * fraction;
+			float sliceFar = CASCADE_SPLIT_LAMBDA * logarithmic + (1.0f - CASCADE_SPLIT_LAMBDA) * uniform;
+			cascade.splitDistance = sliceFar;
+
+			// corners of the slice in world space
+			glm::vec3 corners[8];
+			float distances[2] = { sliceNear, sliceFar };
+			for (int d = 0; d < 2; d++) {
+				for (int c = 0; c < 4; c++) {
+					float x = (c & 1 ? 1.0f : -1.0f) * tanHalfX * distances[d];
+					float y = (c & 2 ? 1.0f : -1.0f) * tanHalfY * distances[d];
+					corners[d * 4 + c] = glm::vec3(cameraToWorld * glm::vec4(x, y, -distances[d], 1.0f));
+				}
+			}
+
+			// a sphere around the slice keeps the box size constant while the camera turns
+			glm::vec3 center(0.0f);
+			for (int c = 0; c < 8; c++)
+				center += corners[c];
+			center /= 8.0f;
+			float radius = 0.0f;
+			for (int c = 0; c < 8; c++)
+				radius = std::max(radius, glm::length(corners[c] - center));
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+
+			// snap the box to whole texels, so shadow edges do not crawl as the camera moves
+			float texelSize = 2.0f * radius / cascade.resolution;
+			glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+			lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+			lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+			// depth too, so the matrix only changes in whole texel steps and a static cache holds
+			lightCenter.z = std::floor(lightCenter.z / texelSize) * texelSize;
+
+			// the light looks down -z; casters up to casterDistance before the slice still count
+			float nearDistance = -(lightCenter.z + radius + casterDistance);
+			float farDistance = -(lightCenter.z - radius);
+			glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+				lightCenter.y - radius, lightCenter.y + radius, nearDistance, farDistance);
+
+			cascade.lightSpaceMatrix = lightProjection * lightView;
+			// only what the camera sees of the slice receives shadows worth drawing
+			Frustum receivers = Frustum::FromMatrix(glm::perspective(fovY, aspect, sliceNear, sliceFar) * cameraView);
+			cascade.casterFrustum = Frustum::ShadowCasters(Frustum::FromMatrix(cascade.lightSpaceMatrix), receivers, towardLight,
+				farDistance - nearDistance);
+			cascade.width = 2.0f * radius;
+			// depth is stored over [0, 1] of the near-far range
+			cascade.depthBias = 1.5f * texelSize / (farDistance - nearDistance);
+
+			if (staticCaching && i >= FIRST_STATIC_CASCADE)
+				FitStaticBox(cascade, lightView, lightEye, glm::length(center - eye), lightCenter, radius, nearDistance, farDistance);
+
+			sliceNear = sliceFar;
+		}
+	}
+
+	void ShadowCascades::SetStaticCaching(bool caching)
+	{
+		if (caching == staticCaching)
+			return;
+		staticCaching = caching;
+
+		if (!caching) {
+			DeleteStaticCache();
+			return;
+		}
+		// the static textures are sized by the next Update
+		for (size_t i = 0; i < cascades.size(); i++)
+			cascades[i].staticValid = false;
+	}
+
+	void ShadowCascades::FitStaticBox(Cascade& cascade, const glm::mat4& lightView, const glm::vec3& lightEye, float reach,
+		const glm::vec3& lightCenter, float radius, float nearDistance, float farDistance)
+	{
+		// the cascade's first texel on the light's texel grid
+		float texelSize = 2.0f * radius / cascade.resolution;
+		int liveX = (int)std::floor((lightCenter.x - radius) / texelSize + 0.5f);
+		int liveY = (int)std::floor((lightCenter.y - radius) / texelSize + 0.5f);
+
+		bool inside = cascade.staticResolution > 0 && cascade.staticLightView == lightView && cascade.staticTexelSize == texelSize &&
+			liveX >= cascade.staticOriginX && liveX + cascade.resolution <= cascade.staticOriginX + cascade.staticResolution &&
+			liveY >= cascade.staticOriginY && liveY + cascade.resolution <= cascade.staticOriginY + cascade.staticResolution &&
+			nearDistance >= cascade.staticNear && farDistance <= cascade.staticFar;
+
+		if (!inside) {
+			// turning in place keeps the slice center within reach of the eye
+			float halfExtent = (reach + radius) * (1.0f + STATIC_BOX_MARGIN);
+			GLsizei resolution = (GLsizei)std::ceil(2.0f * halfExtent / texelSize);
+			resolution = std::max(resolution + (resolution & 1), cascade.resolution);
+			GLint maxSize = 4096;
+			glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+			GLsizei largest = std::min((GLsizei)(cascade.resolution * STATIC_BOX_MAX_SCALE) & ~1, (GLsizei)maxSize);
+			bool coversTurns = resolution <= largest;
+			if (!coversTurns)
+				resolution = largest;
+
+			if (resolution != cascade.staticResolution) {
+				glDeleteFramebuffers(1, &cascade.staticFramebuffer);
+				glDeleteTextures(1, &cascade.staticDepthTexture);
+				CreateDepthTarget(resolution, cascade.staticFramebuffer, cascade.staticDepthTexture);
+				cascade.staticResolution = resolution;
+			}
+
+			// the light looks down -z, as in Update
+			if (coversTurns) {
+				// centered on the eye, the cascade stays inside while the camera turns
+				int originX = (int)std::floor(lightEye.x / texelSize + 0.5f) - resolution / 2;
+				int originY = (int)std::floor(lightEye.y / texelSize + 0.5f) - resolution / 2;
+				cascade.staticOriginX = std::min(std::max(originX, liveX + cascade.resolution - resolution), liveX);
+				cascade.staticOriginY = std::min(std::max(originY, liveY + cascade.resolution - resolution), liveY);
+				cascade.staticNear = std::min(-(lightEye.z + halfExtent + casterDistance), nearDistance);
+				cascade.staticFar = std::max(-(lightEye.z - halfExtent), farDistance);
+			}
+			else {
+				// too large - an even border around the cascade instead
+				int border = (resolution - cascade.resolution) / 2;
+				cascade.staticOriginX = liveX - border;
+				cascade.staticOriginY = liveY - border;
+				cascade.staticNear = nearDistance - border * texelSize;
+				cascade.staticFar = farDistance + border * texelSize;
+			}
+			cascade.staticLightView = lightView;
+			cascade.staticTexelSize = texelSize;
+
+			glm::mat4 staticProjection = glm::ortho(
+				cascade.staticOriginX * texelSize, (cascade.staticOriginX + resolution) * texelSize,
+				cascade.staticOriginY * texelSize, (cascade.staticOriginY + resolution) * texelSize,
+				cascade.staticNear, cascade.staticFar);
+			cascade.staticLightSpaceMatrix = staticProjection * lightView;
+			cascade.staticValid = false;
+		}
+
+		// orthographic depth is linear in the distance, so one scale and offset carry it over
+		float range = farDistance - nearDistance;
+		cascade.staticTexelOffset = glm::vec2((float)(liveX - cascade.staticOriginX), (float)(liveY - cascade.staticOriginY));
+		cascade.staticDepthRemap = glm::vec2((cascade.staticFar - cascade.staticNear) / range, (cascade.staticNear - nearDistance) / range);
+	}
+
+	bool ShadowCascades::IsStaticCaching() const
+	{
+		return staticCaching;
+	}
+
+	bool ShadowCascades::HasStaticCache(int cascade) const
+	{
+		return staticCaching && cascade >= FIRST_STATIC_CASCADE;
+	}
+
+	bool ShadowCascades::NeedsStaticUpdate(int cascade, const glm::mat4& staticModel) const
+	{
+		const Cascade& entry = cascades[cascade];
+		return !entry.staticValid || entry.staticModel != staticModel;
+	}
+
+	void ShadowCascades::BeginStaticCascade(int cascade, const glm::mat4& staticModel)
+	{
+		Cascade& entry = cascades[cascade];
+		entry.staticValid = true;
+		entry.staticModel = staticModel;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, entry.staticFramebuffer);
+		glViewport(0, 0, entry.staticResolution, entry.staticResolution);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	const glm::mat4& ShadowCascades::GetStaticLightSpaceMatrix(int cascade) const
+	{
+		return cascades[cascade].staticLightSpaceMatrix;
+	}
+
+	void ShadowCascades::InvalidateStaticCache()
+	{
+		for (size_t i = 0; i < cascades.size(); i++)
+			cascades[i].staticValid = false;
+	}
+
+	void ShadowCascades::BeginCascade(int cascade, gps::Shader& copyShader)
+	{
+		const Cascade& entry = cascades[cascade];
+		glBindFramebuffer(GL_FRAMEBUFFER, entry.framebuffer);
+		glViewport(0, 0, entry.resolution, entry.resolution);
+		if (!staticCaching || !entry.staticValid) {
+			glClear(GL_DEPTH_BUFFER_BIT);
+			return;
+		}
+
+		// the boxes share their texel grid, so every cascade texel reads one static texel;
+		// the triangle covers them all and replaces the clear
+		if (!copyVAO)
+			glGenVertexArrays(1, &copyVAO);
+		copyShader.useShaderProgram();
+		copyShader.setUniform(STATIC_DEPTH_UNIFORM, 0);
+		copyShader.setUniform(STATIC_TEXEL_OFFSET_UNIFORM, entry.staticTexelOffset);
+		copyShader.setUniform(STATIC_DEPTH_REMAP_UNIFORM, entry.staticDepthRemap);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, entry.staticDepthTexture);
+
+		glDepthFunc(GL_ALWAYS);
+		glBindVertexArray(copyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glDepthFunc(GL_LESS);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	int ShadowCascades::GetCascadeCount() const
+	{
+		return (int)cascades.size();
+	}
+
+	GLsizei ShadowCascades::GetResolution(int cascade) const
+	{
+		return cascades[cascade].resolution;
+	}
+
+	GLuint ShadowCascades::GetDepthTexture(int cascade) const
+	{
+		return cascades[cascade].depthTexture;
+	}
+
+	const glm::mat4& ShadowCascades::GetLightSpaceMatrix(int cascade) const
+	{
+		return cascades[cascade].lightSpaceMatrix;
+	}
+
+	const Frustum& ShadowCascades::GetCasterFrustum(int cascade) const
+	{
+		return cascades[cascade].casterFrustum;
+	}
+
+	float ShadowCascades::GetSplitDistance(int cascade) const
+	{
+		return cascades[cascade].splitDistance;
+	}
+
+	float ShadowCascades::GetWidth(int cascade) const
+	{
+		return cascades[cascade].width;
+	}
+
+	float ShadowCascades::GetDepthBias(int cascade) const
+	{
+		return cascades[cascade].depthBias;
+	}
+
+	size_t ShadowCascades::GetMemoryBytes() const
+	{
+		// 24-bit depth is stored in 32 bits; the static textures count once Update sized them
+		size_t bytes = 0;
+		for (size_t i = 0; i < cascades.size(); i++) {
+			bytes += (size_t)cascades[i].resolution * cascades[i].resolution * 4;
+			bytes += (size_t)cascades[i].staticResolution * cascades[i].staticResolution * 4;
+		}
+		return bytes;
+	}
+}
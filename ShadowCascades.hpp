@@ -0,0 +1,131 @@
+#ifndef ShadowCascades_hpp
+#define ShadowCascades_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "Frustum.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+// Most cascades basic.frag can select from
+const int MAX_SHADOW_CASCADES = 4;
+
+// Directional light shadow maps split along the camera view: every cascade covers one
+// slice of the view frustum with its own depth texture, so the texels go where the camera
+// looks instead of being spread over a fixed box around the scene
+class ShadowCascades
+{
+public:
+    ShadowCascades();
+    ~ShadowCascades();
+
+    ShadowCascades(const ShadowCascades&) = delete;
+    ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+    // One cascade per resolution (at most MAX_SHADOW_CASCADES), nearest first. Shadows reach
+    // shadowDistance from the camera; casterDistance is how far toward the light beyond a
+    // slice objects can still throw shadows into it.
+    void Create(const std::vector<GLsizei>& resolutions, float shadowDistance, float casterDistance);
+
+    // Fits the cascades to the camera; lightDirection points toward the light
+    void Update(const glm::mat4& cameraView, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection);
+
+    // Keeps the depth of the static casters in a second, larger texture per cascade but the
+    // nearest, so that only the moving ones are drawn every frame (off by default). Its light
+    // box is on the same texel grid as the cascade and, within at most 1.5 times the
+    // cascade's resolution, covers every box the slice takes while the camera turns in place;
+    // Update only moves it when the cascade leaves it or the light turns.
+    void SetStaticCaching(bool caching);
+    bool IsStaticCaching() const;
+
+    // Whether a cascade is drawn from a static cache (see NeedsStaticUpdate) or in full
+    bool HasStaticCache(int cascade) const;
+
+    // Whether the static casters of a cascade must be drawn again: the cache holds for one
+    // static light box and one transform of the static scene
+    bool NeedsStaticUpdate(int cascade, const glm::mat4& staticModel) const;
+
+    // Binds the static cache of one cascade and clears it, for drawing the static casters
+    // with GetStaticLightSpaceMatrix
+    void BeginStaticCascade(int cascade, const glm::mat4& staticModel);
+
+    const glm::mat4& GetStaticLightSpaceMatrix(int cascade) const;
+
+    // Forgets every cached cascade, e.g. after the static casters themselves changed
+    void InvalidateStaticCache();
+
+    // Binds the framebuffer and viewport of one cascade and clears its depth - or, with
+    // static caching, starts it from its part of the static depth, copied over with
+    // copyShader (shadowCacheCopy.vert/.frag)
+    void BeginCascade(int cascade, gps::Shader& copyShader);
+
+    int GetCascadeCount() const;
+    GLsizei GetResolution(int cascade) const;
+    GLuint GetDepthTexture(int cascade) const;
+    const glm::mat4& GetLightSpaceMatrix(int cascade) const;
+    // World space volume of the casters that shadow the visible part of the cascade's slice
+    const Frustum& GetCasterFrustum(int cascade) const;
+    // view space distance at which the cascade ends
+    float GetSplitDistance(int cascade) const;
+    // width of the cascade's light box, in world units
+    float GetWidth(int cascade) const;
+    // depth bias that amounts to about one and a half texels of the cascade
+    float GetDepthBias(int cascade) const;
+
+    size_t GetMemoryBytes() const;
+
+private:
+    struct Cascade
+    {
+        GLsizei resolution;
+        GLuint framebuffer;
+        GLuint depthTexture;
+        // static caching only
+        GLuint staticFramebuffer;
+        GLuint staticDepthTexture;
+        // size of the static texture, 0 until Update allocates it
+        GLsizei staticResolution;
+        bool staticValid;
+        // static light box: its first texel on the light's texel grid and its depth range
+        glm::mat4 staticLightView;
+        float staticTexelSize;
+        int staticOriginX;
+        int staticOriginY;
+        float staticNear;
+        float staticFar;
+        glm::mat4 staticLightSpaceMatrix;
+        glm::mat4 staticModel;
+        // where the cascade sits in the static box: first texel, and the static depth to
+        // cascade depth mapping (scale, offset)
+        glm::vec2 staticTexelOffset;
+        glm::vec2 staticDepthRemap;
+        glm::mat4 lightSpaceMatrix;
+        Frustum casterFrustum;
+        float splitDistance;
+        float width;
+        float depthBias;
+    };
+
+    std::vector<Cascade> cascades;
+    float shadowDistance;
+    float casterDistance;
+    bool staticCaching;
+    // empty, the static copy draws a triangle from gl_VertexID alone
+    GLuint copyVAO;
+
+    void Delete();
+    void DeleteStaticCache();
+    // Moves the static box of a cascade if the cascade's light box left it; reach is how far
+    // the slice center is from the eye
+    void FitStaticBox(Cascade& cascade, const glm::mat4& lightView, const glm::vec3& lightEye, float reach,
+        const glm::vec3& lightCenter, float radius, float nearDistance, float farDistance);
+    static void CreateDepthTarget(GLsizei resolution, GLuint& framebuffer, GLuint& depthTexture);
+};
+
+}
+
+#endif /* ShadowCascades_hpp */
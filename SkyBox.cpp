@@ -10,6 +10,9 @@
 
 namespace gps {
     
+    static const UniformId INVERSE_VIEW_PROJECTION_UNIFORM = Shader::uniformId("inverseViewProjection");
+    static const UniformId SKYBOX_UNIFORM = Shader::uniformId("skybox");
+    
     SkyBox::SkyBox()
     {
         
@@ -17,52 +20,67 @@ namespace gps {
     
     void SkyBox::Load(std::vector<const GLchar*> cubeMapFaces)
     {
-        cubemapTexture = LoadSkyBoxTextures(cubeMapFaces);
+        TextureDecoder decoder;
+        Parse(cubeMapFaces, decoder);
+        Upload();
+    }
+    
+    void SkyBox::Parse(std::vector<const GLchar*> cubeMapFaces, TextureDecoder& decoder)
+    {
+        pendingFaces.clear();
+        for (GLuint i = 0; i < cubeMapFaces.size(); i++)
+            pendingFaces.push_back(decoder.Decode(cubeMapFaces[i], 3, false));
+    }
+    
+    void SkyBox::Upload()
+    {
+        cubemapTexture = LoadSkyBoxTextures(pendingFaces);
+        pendingFaces.clear();
         InitSkyBox();
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    void SkyBox::Draw(gps::Shader& shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
     {
         shader.useShaderProgram();
         
-        //set the view and projection matrices
+        //only the rotation of the view, the sky is infinitely far away
         glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        glm::mat4 inverseViewProjection = glm::inverse(projectionMatrix * transformedView);
+        shader.setUniform(INVERSE_VIEW_PROJECTION_UNIFORM, inverseViewProjection);
         
+        //drawn after the opaque geometry, the far plane depth passes only where the buffer is still clear
         glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
         
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
+        shader.setUniform(SKYBOX_UNIFORM, 0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
         glBindVertexArray(0);
         
+        glDepthMask(GL_TRUE);
         glDepthFunc(GL_LESS);
     }
     
-    GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
+    GLuint SkyBox::LoadSkyBoxTextures(std::vector<TextureDecoder::Handle> skyBoxFaces)
     {
         GLuint textureID;
         glGenTextures(1, &textureID);
         glActiveTexture(GL_TEXTURE0);
         
-        int width,height, n;
-        unsigned char* image;
-        int force_channels = 3;
-        
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
-            if (!image) {
-                fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
+            //the face was decoded by the worker pool
+            const TextureImage& image = TextureDecoder::Wait(skyBoxFaces[i]);
+            if (!image.pixels) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
                 return false;
             }
             glTexImage2D(
                          GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-                         GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
+                         GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels
                          );
         }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -77,61 +95,8 @@ namespace gps {
     
     void SkyBox::InitSkyBox()
     {
-        GLfloat skyboxVertices[] = {
-            -1.0f,  1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            
-            -1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-            
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            
-            -1.0f, -1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-            
-            -1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f, -1.0f,
-            
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f
-        };
-        
+        //the fullscreen triangle comes from gl_VertexID, but core profile still wants a VAO bound
         glGenVertexArrays(1, &(this->skyboxVAO));
-        glGenBuffers(1, &skyboxVBO);
-        
-        glBindVertexArray(skyboxVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-        
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-        
-        glBindVertexArray(0);
     }
     
     GLuint SkyBox::GetTextureId()
@@ -11,6 +11,7 @@
 
 #include <stdio.h>
 #include "Shader.hpp"
+#include "TextureDecoder.hpp"
 #include <vector>
 #include "stb_image.h"
 #include "glm/glm.hpp"
@@ -22,13 +23,18 @@ namespace gps {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+        //queues the face images on the decoder, which must outlive Upload()
+        void Parse(std::vector<const GLchar*> cubeMapFaces, TextureDecoder& decoder);
+        //waits for the decoded faces and creates the cubemap - GL thread only
+        void Upload();
+        //draws the sky behind everything already in the depth buffer - call after the opaque geometry
+        void Draw(gps::Shader& shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
-        GLuint skyboxVBO;
         GLuint cubemapTexture;
-        GLuint LoadSkyBoxTextures(std::vector<const GLchar*> cubeMapFaces);
+        std::vector<TextureDecoder::Handle> pendingFaces;
+        GLuint LoadSkyBoxTextures(std::vector<TextureDecoder::Handle> cubeMapFaces);
         void InitSkyBox();
     };
 }
@@ -0,0 +1,236 @@
+#include "StaticBatch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace gps {
+
+	static const UniformId POSITION_OFFSET_UNIFORM = Shader::uniformId("positionOffset");
+	static const UniformId POSITION_SCALE_UNIFORM = Shader::uniformId("positionScale");
+
+	StaticBatch::StaticBatch()
+	{
+		buffers.VAO = 0;
+		buffers.VBO = 0;
+		buffers.EBO = 0;
+		indexType = GL_UNSIGNED_SHORT;
+		positionOffset = glm::vec3(0.0f);
+		positionScale = glm::vec3(1.0f);
+		pendingVertexCount = 0;
+		pendingIndexCount = 0;
+		largestMeshVertexCount = 0;
+	}
+
+	StaticBatch::~StaticBatch()
+	{
+		DeleteBuffers();
+	}
+
+	StaticBatch::Group& StaticBatch::FindGroup(const std::vector<Texture>& textures)
+	{
+		for (size_t g = 0; g < groups.size(); g++) {
+			const std::vector<Texture>& groupTextures = groups[g].textures;
+			if (groupTextures.size() != textures.size())
+				continue;
+
+			bool same = true;
+			for (size_t t = 0; t < textures.size() && same; t++)
+				same = groupTextures[t].id == textures[t].id && groupTextures[t].type == textures[t].type;
+			if (same)
+				return groups[g];
+		}
+
+		groups.push_back(Group());
+		groups.back().textures = textures;
+		return groups.back();
+	}
+
+	void StaticBatch::Add(gps::Model3D& model)
+	{
+		const std::vector<BatchMesh>& meshes = model.GetBatchMeshes();
+		if (meshes.empty())
+			std::cerr << "WARNING: static batch got a model without batch meshes" << std::endl;
+
+		for (size_t m = 0; m < meshes.size(); m++) {
+			const MeshGeometry& geometry = meshes[m].geometry;
+			if (geometry.vertexCount == 0 || geometry.indexCount == 0)
+				continue;
+
+			Entry entry;
+			entry.baseVertex = (GLint)pendingVertexCount;
+			entry.firstIndex = (GLuint)pendingIndexCount;
+			entry.lods.assign(geometry.lods, geometry.lods + geometry.lodCount);
+
+			entry.item = (uint32_t)itemBoxes.size();
+			entry.boundingBox = geometry.boundingBox;
+			itemBoxes.push_back(entry.boundingBox);
+			entry.boundingSphere = geometry.boundingSphere;
+			entry.castsShadows = meshes[m].castsShadows;
+
+			// indices stay local to the mesh, the base vertex moves them into place
+			pendingMeshes.push_back(geometry);
+			pendingVertexCount += geometry.vertexCount;
+			pendingIndexCount += geometry.indexCount;
+			largestMeshVertexCount = std::max(largestMeshVertexCount, (size_t)geometry.vertexCount);
+
+			FindGroup(meshes[m].textures).entries.push_back(entry);
+		}
+	}
+
+	void StaticBatch::Build()
+	{
+		DeleteBuffers();
+		if (pendingMeshes.empty())
+			return;
+
+		// one box for the whole batch, since a multi-draw cannot change uniforms per mesh;
+		// the mesh bounds are exact, so it is the box of the meshes' positions
+		BoundingBox batchBox = GetBoundingBox();
+		positionOffset = batchBox.minimum;
+		positionScale = batchBox.maximum - batchBox.minimum;
+		for (int axis = 0; axis < 3; axis++) {
+			if (positionScale[axis] <= 0.0f)
+				positionScale[axis] = 1.0f;
+		}
+
+		// local indices only have to address the largest mesh
+		indexType = largestMeshVertexCount < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		std::vector<PackedVertex> packedVertices;
+		std::vector<GLushort> shortIndices;
+		std::vector<GLuint> intIndices;
+		packedVertices.reserve(pendingVertexCount);
+		if (indexType == GL_UNSIGNED_SHORT)
+			shortIndices.reserve(pendingIndexCount);
+		else
+			intIndices.reserve(pendingIndexCount);
+
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+			const MeshGeometry& geometry = pendingMeshes[m];
+			RequantizeVertices(geometry, positionOffset, positionScale, packedVertices);
+			for (GLuint i = 0; i < geometry.indexCount; i++) {
+				GLuint index = geometry.indexType == GL_UNSIGNED_SHORT ? ((const GLushort*)geometry.indices)[i] : ((const GLuint*)geometry.indices)[i];
+				if (indexType == GL_UNSIGNED_SHORT)
+					shortIndices.push_back((GLushort)index);
+				else
+					intIndices.push_back(index);
+			}
+		}
+
+		glGenVertexArrays(1, &buffers.VAO);
+		glGenBuffers(1, &buffers.VBO);
+		glGenBuffers(1, &buffers.EBO);
+
+		glBindVertexArray(buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, packedVertices.size() * sizeof(PackedVertex), packedVertices.data(), GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+		if (indexType == GL_UNSIGNED_SHORT)
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+		else
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, intIndices.size() * sizeof(GLuint), intIndices.data(), GL_STATIC_DRAW);
+
+		// same layout as Mesh
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+
+		glBindVertexArray(0);
+
+		std::chrono::high_resolution_clock::time_point buildStart = std::chrono::high_resolution_clock::now();
+		bvh.Build(itemBoxes);
+		double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+		std::cout << "Static batch : " << itemBoxes.size() << " meshes, " << pendingVertexCount << " vertices in "
+			<< groups.size() << " draw groups, " << bvh.GetNodeCount() << " BVH nodes built in " << buildMs << " ms" << std::endl;
+
+		std::vector<MeshGeometry>().swap(pendingMeshes);
+		pendingVertexCount = 0;
+		pendingIndexCount = 0;
+	}
+
+	void StaticBatch::Draw(gps::Shader& shader, const glm::mat4& model)
+	{
+		if (!buffers.VAO)
+			return;
+
+		shader.useShaderProgram();
+		shader.setUniform(POSITION_OFFSET_UNIFORM, positionOffset);
+		shader.setUniform(POSITION_SCALE_UNIFORM, positionScale);
+		glBindVertexArray(buffers.VAO);
+
+		const LodView& view = Model3D::GetLodView();
+		size_t indexSize = IndexSize(indexType);
+
+		bvh.QueryFrustum(Model3D::GetCullFrustum().Transformed(model), itemVisible);
+		bool shadowPass = Model3D::IsShadowPass();
+
+		for (size_t g = 0; g < groups.size(); g++) {
+			const Group& group = groups[g];
+
+			drawCounts.clear();
+			drawOffsets.clear();
+			drawBaseVertices.clear();
+			for (size_t e = 0; e < group.entries.size(); e++) {
+				const Entry& entry = group.entries[e];
+				if (!itemVisible[entry.item] || (shadowPass && !entry.castsShadows))
+					continue;
+
+				int lod = SelectLod(view, model, entry.boundingSphere.center, entry.boundingSphere.radius, (int)entry.lods.size());
+				const MeshLod& range = entry.lods[lod];
+
+				drawCounts.push_back((GLsizei)range.indexCount);
+				drawOffsets.push_back((const GLvoid*)((size_t)(entry.firstIndex + range.indexOffset) * indexSize));
+				drawBaseVertices.push_back(entry.baseVertex);
+			}
+			if (drawCounts.empty())
+				continue;
+
+			for (GLuint i = 0; i < group.textures.size(); i++) {
+				glActiveTexture(GL_TEXTURE0 + i);
+				shader.setUniform(group.textures[i].uniform, (GLint)i);
+				glBindTexture(GL_TEXTURE_2D, group.textures[i].id);
+			}
+
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(),
+				(GLsizei)drawCounts.size(), drawBaseVertices.data());
+
+			for (GLuint i = 0; i < group.textures.size(); i++) {
+				glActiveTexture(GL_TEXTURE0 + i);
+				glBindTexture(GL_TEXTURE_2D, 0);
+			}
+		}
+
+		glBindVertexArray(0);
+	}
+
+	size_t StaticBatch::GetGroupCount() const
+	{
+		return groups.size();
+	}
+
+	BoundingBox StaticBatch::GetBoundingBox() const
+	{
+		BoundingBox box = { glm::vec3(0.0f), glm::vec3(0.0f) };
+		for (size_t i = 0; i < itemBoxes.size(); i++) {
+			box.minimum = i == 0 ? itemBoxes[i].minimum : glm::min(box.minimum, itemBoxes[i].minimum);
+			box.maximum = i == 0 ? itemBoxes[i].maximum : glm::max(box.maximum, itemBoxes[i].maximum);
+		}
+		return box;
+	}
+
+	void StaticBatch::DeleteBuffers()
+	{
+		// deleting the name 0 is silently ignored by GL
+		glDeleteBuffers(1, &buffers.VBO);
+		glDeleteBuffers(1, &buffers.EBO);
+		glDeleteVertexArrays(1, &buffers.VAO);
+		buffers.VAO = 0;
+		buffers.VBO = 0;
+		buffers.EBO = 0;
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef StaticBatch_hpp
+#define StaticBatch_hpp
+
+#include "Mesh.hpp"
+#include "Model3D.hpp"
+#include "SceneBvh.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+// Packs the meshes of models that never move relative to each other into one shared
+// vertex/index buffer. Meshes with the same textures form a group that is submitted
+// with a single glMultiDrawElementsBaseVertex, so a draw costs one VAO bind and one
+// call per material instead of one per mesh.
+class StaticBatch
+{
+public:
+    StaticBatch();
+    ~StaticBatch();
+
+    StaticBatch(const StaticBatch&) = delete;
+    StaticBatch& operator=(const StaticBatch&) = delete;
+
+    // Queues the meshes of model; it must have been loaded with SetBatched(true)
+    void Add(gps::Model3D& model);
+
+    // Uploads everything added, once after the last Add; the models may release their
+    // batch meshes afterwards
+    void Build();
+
+    // Draws every group with the model matrix already set on shader. Meshes outside
+    // Model3D::GetCullFrustum() are found through the hierarchy and left out, the rest
+    // use the level of detail picked against Model3D::GetLodView(). Shadow passes leave
+    // out the meshes that cast no shadow.
+    void Draw(gps::Shader& shader, const glm::mat4& model);
+
+    // Number of glMultiDrawElementsBaseVertex calls Draw makes
+    size_t GetGroupCount() const;
+
+    // Model space box around every mesh in the batch
+    BoundingBox GetBoundingBox() const;
+
+private:
+    // One source mesh inside the shared buffers
+    struct Entry
+    {
+        // item of the mesh in the hierarchy
+        uint32_t item;
+        GLint baseVertex;
+        // first index of the mesh in the shared index buffer
+        GLuint firstIndex;
+        std::vector<MeshLod> lods;
+        // model space bounds, for culling and the LOD choice
+        BoundingBox boundingBox;
+        BoundingSphere boundingSphere;
+        bool castsShadows;
+    };
+
+    // Meshes sharing the same textures
+    struct Group
+    {
+        std::vector<Texture> textures;
+        std::vector<Entry> entries;
+    };
+
+    Buffers buffers;
+    GLenum indexType;
+    // dequantization shared by the whole batch
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    std::vector<Group> groups;
+
+    // geometry waiting for Build, still owned by the models
+    std::vector<MeshGeometry> pendingMeshes;
+    size_t pendingVertexCount;
+    size_t pendingIndexCount;
+    size_t largestMeshVertexCount;
+
+    // per draw scratch for the multi-draw arguments
+    std::vector<GLsizei> drawCounts;
+    std::vector<const GLvoid*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+    // model space hierarchy over the meshes - the batch never moves inside it, so it is
+    // queried with the frustum taken to model space and never rebuilt
+    SceneBvh bvh;
+    std::vector<BoundingBox> itemBoxes;
+    std::vector<unsigned char> itemVisible;
+
+    Group& FindGroup(const std::vector<Texture>& textures);
+    void DeleteBuffers();
+};
+
+}
+
+#endif /* StaticBatch_hpp */
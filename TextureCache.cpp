@@ -0,0 +1,146 @@
+#include "TextureCache.hpp"
+
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <limits.h>
+#endif
+
+namespace gps {
+
+    struct TextureEntry
+    {
+        GLuint id;
+        int refCount;
+        bool hashed;
+        uint64_t contentHash;
+        std::vector<std::string> paths;
+    };
+
+    struct TextureRegistry
+    {
+        std::mutex mutex;
+        std::unordered_map<GLuint, TextureEntry> entries;
+        std::unordered_map<std::string, GLuint> entriesByPath;
+        std::unordered_map<uint64_t, GLuint> entriesByHash;
+        bool contentHashing = true;
+    };
+
+    // Never destroyed: global Model3D objects release their textures during static
+    // destruction, in an order relative to this file that C++ does not define
+    static TextureRegistry& GetRegistry()
+    {
+        static TextureRegistry* registry = new TextureRegistry();
+        return *registry;
+    }
+
+    std::string TextureCache::CanonicalPath(std::string path)
+    {
+#ifdef _WIN32
+        char resolved[_MAX_PATH];
+        std::string canonical = _fullpath(resolved, path.c_str(), _MAX_PATH) ? resolved : path;
+        for (size_t i = 0; i < canonical.size(); i++) {
+            if (canonical[i] == '\\')
+                canonical[i] = '/';
+            // NTFS paths are case insensitive
+            canonical[i] = (char)tolower((unsigned char)canonical[i]);
+        }
+        return canonical;
+#else
+        char resolved[PATH_MAX];
+        return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+#endif
+    }
+
+    GLuint TextureCache::Acquire(std::string path, const uint64_t* contentHash, std::function<GLuint()> upload)
+    {
+        std::string canonical = CanonicalPath(path);
+
+        TextureRegistry& registry = GetRegistry();
+        std::unique_lock<std::mutex> lock(registry.mutex);
+        std::unordered_map<std::string, GLuint>::iterator byPath = registry.entriesByPath.find(canonical);
+        if (byPath != registry.entriesByPath.end()) {
+            registry.entries[byPath->second].refCount++;
+            return byPath->second;
+        }
+
+        // same bytes under a different name share the texture as well
+        bool hashed = registry.contentHashing && contentHash != NULL;
+        if (hashed) {
+            std::unordered_map<uint64_t, GLuint>::iterator byHash = registry.entriesByHash.find(*contentHash);
+            if (byHash != registry.entriesByHash.end()) {
+                TextureEntry& entry = registry.entries[byHash->second];
+                entry.refCount++;
+                entry.paths.push_back(canonical);
+                registry.entriesByPath[canonical] = entry.id;
+                return entry.id;
+            }
+        }
+
+        // upload outside the lock, IsResident may be polled by the workers meanwhile
+        lock.unlock();
+        GLuint id = upload();
+        lock.lock();
+        if (id == 0)
+            return 0;
+
+        TextureEntry entry;
+        entry.id = id;
+        entry.refCount = 1;
+        entry.hashed = hashed;
+        entry.contentHash = hashed ? *contentHash : 0;
+        entry.paths.push_back(canonical);
+        registry.entries[id] = entry;
+        registry.entriesByPath[canonical] = id;
+        if (hashed)
+            registry.entriesByHash[*contentHash] = id;
+
+        return id;
+    }
+
+    void TextureCache::Release(GLuint textureId)
+    {
+        TextureRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::unordered_map<GLuint, TextureEntry>::iterator found = registry.entries.find(textureId);
+        if (found == registry.entries.end())
+            return;
+
+        TextureEntry& entry = found->second;
+        if (--entry.refCount > 0)
+            return;
+
+        for (size_t i = 0; i < entry.paths.size(); i++)
+            registry.entriesByPath.erase(entry.paths[i]);
+        if (entry.hashed)
+            registry.entriesByHash.erase(entry.contentHash);
+        glDeleteTextures(1, &entry.id);
+        registry.entries.erase(found);
+    }
+
+    bool TextureCache::IsResident(std::string path)
+    {
+        std::string canonical = CanonicalPath(path);
+
+        TextureRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        return registry.entriesByPath.find(canonical) != registry.entriesByPath.end();
+    }
+
+    void TextureCache::SetContentHashing(bool enabled)
+    {
+        TextureRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.contentHashing = enabled;
+    }
+
+    size_t TextureCache::GetResidentCount()
+    {
+        TextureRegistry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        return registry.entries.size();
+    }
+}
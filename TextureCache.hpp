@@ -0,0 +1,42 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace gps {
+
+// Process-wide registry of GL textures shared by every Model3D. Entries are found
+// by canonical path and, when content hashing is on, by the hash of the file
+// bytes, so one image is decoded and uploaded once no matter how many models or
+// paths refer to it. Each Acquire must be matched by a Release.
+class TextureCache
+{
+public:
+    // Returns the texture of path with one more reference; if nothing identical is
+    // resident, upload() is called to create it (GL thread only). contentHash is the
+    // hash of the file bytes when the caller has it (TextureImage::contentHash, computed
+    // by the decoder); with NULL the texture is only found by its path. The file is
+    // never read here.
+    static GLuint Acquire(std::string path, const uint64_t* contentHash, std::function<GLuint()> upload);
+
+    // Drops a reference and deletes the texture once nobody uses it
+    static void Release(GLuint textureId);
+
+    // True if path is already resident - lets loaders skip decoding it; thread safe
+    static bool IsResident(std::string path);
+
+    static void SetContentHashing(bool enabled);
+
+    static size_t GetResidentCount();
+
+    // Absolute path with '.' and '..' resolved and a single separator style
+    static std::string CanonicalPath(std::string path);
+};
+
+}
+
+#endif /* TextureCache_hpp */
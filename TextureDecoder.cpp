@@ -0,0 +1,112 @@
+#include "TextureDecoder.hpp"
+#include "Hash.hpp"
+
+#include "stb_image.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <vector>
+
+namespace gps {
+
+    TextureImage::TextureImage()
+    {
+        width = 0;
+        height = 0;
+        channels = 0;
+        pixels = NULL;
+        hashed = false;
+        contentHash = 0;
+    }
+
+    TextureImage::~TextureImage()
+    {
+        if (pixels)
+            stbi_image_free(pixels);
+    }
+
+    TextureDecoder::TextureDecoder(ThreadPool* pool)
+    {
+        this->pool = pool;
+    }
+
+    TextureDecoder::Handle TextureDecoder::Decode(std::string path, int channels, bool flipVertically)
+    {
+        std::string key = path + (flipVertically ? "|flip|" : "|") + std::to_string(channels);
+
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        std::map<std::string, Handle>::iterator found = jobs.find(key);
+        if (found != jobs.end())
+            return found->second;
+
+        Handle job = std::make_shared<Job>();
+        TextureImage* image = &job->image;
+        if (pool) {
+            job->done = pool->Submit([path, channels, flipVertically, image] {
+                DecodeFile(path, channels, flipVertically, *image);
+            }).share();
+        }
+        else {
+            std::promise<void> decoded;
+            DecodeFile(path, channels, flipVertically, *image);
+            decoded.set_value();
+            job->done = decoded.get_future().share();
+        }
+
+        jobs[key] = job;
+        return job;
+    }
+
+    const TextureImage& TextureDecoder::Wait(Handle handle)
+    {
+        handle->done.wait();
+        return handle->image;
+    }
+
+    bool TextureDecoder::DecodeFile(std::string path, int channels, bool flipVertically, TextureImage& image)
+    {
+        image.path = path;
+
+        // the bytes are read here once, for the content hash and the decoder both
+        std::ifstream file(path.c_str(), std::ios::binary);
+        std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        unsigned char* image_data = NULL;
+        int x, y, n;
+        if (file && !bytes.empty()) {
+            image.contentHash = HashBytes(&bytes[0], bytes.size());
+            image.hashed = true;
+            image_data = stbi_load_from_memory(&bytes[0], (int)bytes.size(), &x, &y, &n, channels);
+        }
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+            return false;
+        }
+
+        if (flipVertically) {
+            int width_in_bytes = x * channels;
+            unsigned char *top = NULL;
+            unsigned char *bottom = NULL;
+            unsigned char temp = 0;
+            int half_height = y / 2;
+
+            for (int row = 0; row < half_height; row++) {
+                top = image_data + row * width_in_bytes;
+                bottom = image_data + (y - row - 1) * width_in_bytes;
+                for (int col = 0; col < width_in_bytes; col++) {
+                    temp = *top;
+                    *top = *bottom;
+                    *bottom = temp;
+                    top++;
+                    bottom++;
+                }
+            }
+        }
+
+        image.width = x;
+        image.height = y;
+        image.channels = channels;
+        image.pixels = image_data;
+        return true;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef TextureDecoder_hpp
+#define TextureDecoder_hpp
+
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace gps {
+
+// Pixels of one image file, decoded by stb_image
+struct TextureImage
+{
+    std::string path;
+    int width;
+    int height;
+    int channels;
+    unsigned char* pixels;
+    // HashBytes of the file, computed while it is read for decoding (see TextureCache::Acquire)
+    bool hashed;
+    uint64_t contentHash;
+
+    TextureImage();
+    ~TextureImage();
+
+    TextureImage(const TextureImage&) = delete;
+    TextureImage& operator=(const TextureImage&) = delete;
+};
+
+// Job queue that decodes image files on a worker pool. The GL thread only waits
+// for the finished pixels and uploads them. Each file is decoded once.
+class TextureDecoder
+{
+public:
+    struct Job
+    {
+        TextureImage image;
+        std::shared_future<void> done;
+    };
+    typedef std::shared_ptr<Job> Handle;
+
+    // With no pool every image is decoded right away on the calling thread
+    TextureDecoder(ThreadPool* pool = NULL);
+
+    // Queues path for decoding to `channels` components; safe to call from workers
+    Handle Decode(std::string path, int channels, bool flipVertically);
+
+    // Blocks until the job is done; pixels is NULL if the file could not be read
+    static const TextureImage& Wait(Handle handle);
+
+    // Decodes on the calling thread
+    static bool DecodeFile(std::string path, int channels, bool flipVertically, TextureImage& image);
+
+private:
+    ThreadPool* pool;
+    std::mutex jobsMutex;
+    std::map<std::string, Handle> jobs;
+};
+
+}
+
+#endif /* TextureDecoder_hpp */
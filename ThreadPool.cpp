@@ -0,0 +1,63 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+    ThreadPool::ThreadPool(size_t threadCount)
+    {
+        stopping = false;
+
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 2;
+
+        for (size_t i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            stopping = true;
+        }
+        jobsAvailable.notify_all();
+
+        // workers drain the queue before they exit
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    std::future<void> ThreadPool::Submit(std::function<void()> job)
+    {
+        std::packaged_task<void()> task(job);
+        std::future<void> result = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            jobs.push(std::move(task));
+        }
+        jobsAvailable.notify_one();
+        return result;
+    }
+
+    size_t ThreadPool::GetThreadCount()
+    {
+        return workers.size();
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        for (;;) {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(jobsMutex);
+                jobsAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                task = std::move(jobs.front());
+                jobs.pop();
+            }
+            task();
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+// Fixed set of worker threads that run queued jobs in submission order
+class ThreadPool
+{
+public:
+    // threadCount = 0 uses one worker per hardware thread
+    ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues a job; the future becomes ready (or holds the exception) once it ran
+    std::future<void> Submit(std::function<void()> job);
+
+    size_t GetThreadCount();
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::packaged_task<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsAvailable;
+    bool stopping;
+
+    void WorkerLoop();
+};
+
+}
+
+#endif /* ThreadPool_hpp */
@@ -0,0 +1,66 @@
+#include "UniformBuffer.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+	UniformBuffer::UniformBuffer()
+	{
+		buffer = 0;
+		binding = 0;
+		blockSize = 0;
+		stride = 0;
+		slotCount = 0;
+		boundSlot = -1;
+	}
+
+	UniformBuffer::~UniformBuffer()
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+
+	void UniformBuffer::Create(GLuint binding, size_t blockSize, int slotCount)
+	{
+		this->binding = binding;
+		this->blockSize = blockSize;
+		this->slotCount = slotCount;
+		boundSlot = -1;
+
+		// glBindBufferRange offsets must be multiples of the alignment
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = (blockSize + alignment - 1) / alignment * alignment;
+		staging.assign(stride * slotCount, 0);
+
+		if (!buffer)
+			glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, staging.size(), &staging[0], GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void UniformBuffer::Write(int slot, const void* data)
+	{
+		if (slot < 0 || slot >= slotCount)
+			return;
+		memcpy(&staging[slot * stride], data, blockSize);
+	}
+
+	void UniformBuffer::Upload()
+	{
+		if (!buffer)
+			return;
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), &staging[0]);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void UniformBuffer::Bind(int slot)
+	{
+		if (!buffer || slot < 0 || slot >= slotCount || slot == boundSlot)
+			return;
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, slot * stride, blockSize);
+		boundSlot = slot;
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef UniformBuffer_hpp
+#define UniformBuffer_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+// Uniform buffer holding slotCount copies of one std140 block, e.g. one per object. The
+// slots are written on the CPU and sent in a single upload per frame; Bind points the
+// block's binding point at one of them. Shaders find the binding point through
+// Shader::bindUniformBlock.
+class UniformBuffer
+{
+public:
+    UniformBuffer();
+    ~UniformBuffer();
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    // blockSize is the size of the std140 block, the slots are spaced by the offset alignment
+    void Create(GLuint binding, size_t blockSize, int slotCount);
+
+    // Copies blockSize bytes into a slot, sent by the next Upload
+    void Write(int slot, const void* data);
+
+    // Sends every slot, orphaning the storage the previous frame may still be reading
+    void Upload();
+
+    // Binds a slot to the binding point; rebinding the bound slot is skipped
+    void Bind(int slot);
+
+private:
+    GLuint buffer;
+    GLuint binding;
+    size_t blockSize;
+    size_t stride;
+    int slotCount;
+    int boundSlot;
+    std::vector<unsigned char> staging;
+};
+
+}
+
+#endif /* UniformBuffer_hpp */
@@ -0,0 +1,164 @@
+#include "VertexFormat.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	MeshGeometry PackedMesh::GetGeometry() const
+	{
+		MeshGeometry geometry;
+		geometry.vertices = vertices.data();
+		geometry.vertexCount = (GLuint)vertices.size();
+		if (!intIndices.empty()) {
+			geometry.indices = intIndices.data();
+			geometry.indexCount = (GLuint)intIndices.size();
+			geometry.indexType = GL_UNSIGNED_INT;
+		}
+		else {
+			geometry.indices = shortIndices.data();
+			geometry.indexCount = (GLuint)shortIndices.size();
+			geometry.indexType = GL_UNSIGNED_SHORT;
+		}
+		geometry.positionOffset = positionOffset;
+		geometry.positionScale = positionScale;
+		geometry.boundingBox = boundingBox;
+		geometry.boundingSphere = boundingSphere;
+
+		if (lods.empty()) {
+			geometry.lodCount = 1;
+			geometry.lods[0].indexOffset = 0;
+			geometry.lods[0].indexCount = geometry.indexCount;
+		}
+		else {
+			geometry.lodCount = (GLuint)std::min(lods.size(), (size_t)MAX_MESH_LODS);
+			for (GLuint i = 0; i < geometry.lodCount; i++)
+				geometry.lods[i] = lods[i];
+		}
+		return geometry;
+	}
+
+	void ComputeQuantizationBox(const std::vector<Vertex>& vertices, glm::vec3& positionOffset, glm::vec3& positionScale)
+	{
+		glm::vec3 minimum(0.0f), maximum(0.0f);
+		for (size_t i = 0; i < vertices.size(); i++) {
+			minimum = i == 0 ? vertices[i].Position : glm::min(minimum, vertices[i].Position);
+			maximum = i == 0 ? vertices[i].Position : glm::max(maximum, vertices[i].Position);
+		}
+		glm::vec3 extent = maximum - minimum;
+		for (int axis = 0; axis < 3; axis++) {
+			// flat meshes (e.g. the ground) have no extent along one axis
+			if (extent[axis] <= 0.0f)
+				extent[axis] = 1.0f;
+		}
+		positionOffset = minimum;
+		positionScale = extent;
+	}
+
+	void ComputeBounds(const std::vector<Vertex>& vertices, BoundingBox& box, BoundingSphere& sphere)
+	{
+		box.minimum = box.maximum = glm::vec3(0.0f);
+		for (size_t i = 0; i < vertices.size(); i++) {
+			box.minimum = i == 0 ? vertices[i].Position : glm::min(box.minimum, vertices[i].Position);
+			box.maximum = i == 0 ? vertices[i].Position : glm::max(box.maximum, vertices[i].Position);
+		}
+
+		// tighter than half the box diagonal for most shapes
+		sphere.center = (box.minimum + box.maximum) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (size_t i = 0; i < vertices.size(); i++) {
+			glm::vec3 offset = vertices[i].Position - sphere.center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		sphere.radius = std::sqrt(radiusSquared);
+	}
+
+	void PackVertices(const std::vector<Vertex>& vertices, glm::vec3 positionOffset, glm::vec3 positionScale, std::vector<PackedVertex>& packed)
+	{
+		packed.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const Vertex& vertex = vertices[i];
+			PackedVertex& packedVertex = packed[i];
+
+			for (int axis = 0; axis < 3; axis++) {
+				float unit = (vertex.Position[axis] - positionOffset[axis]) / positionScale[axis];
+				packedVertex.Position[axis] = (GLushort)std::floor(glm::clamp(unit, 0.0f, 1.0f) * 65535.0f + 0.5f);
+			}
+			packedVertex.Position[3] = 0;
+
+			glm::vec3 normal = vertex.Normal;
+			float normalLength = glm::length(normal);
+			normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f, 1.0f, 0.0f);
+			packedVertex.Normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+
+			packedVertex.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+			packedVertex.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+		}
+	}
+
+	PackedMesh PackMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::vector<MeshLod>& lods)
+	{
+		PackedMesh packed;
+		packed.lods = lods;
+
+		// bounding box the positions are quantized against
+		ComputeQuantizationBox(vertices, packed.positionOffset, packed.positionScale);
+		ComputeBounds(vertices, packed.boundingBox, packed.boundingSphere);
+		PackVertices(vertices, packed.positionOffset, packed.positionScale, packed.vertices);
+
+		if (vertices.size() < 65536) {
+			packed.shortIndices.assign(indices.begin(), indices.end());
+		}
+		else {
+			packed.intIndices = indices;
+		}
+
+		return packed;
+	}
+
+	void RequantizeVertices(const MeshGeometry& geometry, glm::vec3 positionOffset, glm::vec3 positionScale, std::vector<PackedVertex>& packed)
+	{
+		size_t first = packed.size();
+		packed.insert(packed.end(), geometry.vertices, geometry.vertices + geometry.vertexCount);
+		if (geometry.positionOffset == positionOffset && geometry.positionScale == positionScale)
+			return;
+
+		// double precision, so the only rounding added is the final one
+		for (size_t i = first; i < packed.size(); i++) {
+			for (int axis = 0; axis < 3; axis++) {
+				double position = (double)geometry.positionOffset[axis] + (double)geometry.positionScale[axis] * (packed[i].Position[axis] / 65535.0);
+				double unit = (position - positionOffset[axis]) / positionScale[axis];
+				packed[i].Position[axis] = (GLushort)std::floor(std::min(std::max(unit, 0.0), 1.0) * 65535.0 + 0.5);
+			}
+		}
+	}
+
+	void UnpackMesh(const MeshGeometry& geometry, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		vertices.resize(geometry.vertexCount);
+		for (GLuint i = 0; i < geometry.vertexCount; i++) {
+			const PackedVertex& packedVertex = geometry.vertices[i];
+			Vertex& vertex = vertices[i];
+
+			for (int axis = 0; axis < 3; axis++)
+				vertex.Position[axis] = geometry.positionOffset[axis] + geometry.positionScale[axis] * (packedVertex.Position[axis] / 65535.0f);
+			vertex.Normal = glm::vec3(glm::unpackSnorm3x10_1x2(packedVertex.Normal));
+			vertex.TexCoords = glm::vec2(glm::unpackHalf1x16(packedVertex.TexCoords[0]), glm::unpackHalf1x16(packedVertex.TexCoords[1]));
+		}
+
+		indices.resize(geometry.indexCount);
+		for (GLuint i = 0; i < geometry.indexCount; i++) {
+			if (geometry.indexType == GL_UNSIGNED_SHORT)
+				indices[i] = ((const GLushort*)geometry.indices)[i];
+			else
+				indices[i] = ((const GLuint*)geometry.indices)[i];
+		}
+	}
+
+	size_t IndexSize(GLenum indexType)
+	{
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+}
@@ -0,0 +1,128 @@
+#ifndef VertexFormat_hpp
+#define VertexFormat_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "Frustum.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace gps {
+
+// Full precision vertex, used while importing and processing meshes on the CPU
+struct Vertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+
+    bool operator==(const Vertex& other) const
+    {
+        return Position == other.Position && Normal == other.Normal && TexCoords == other.TexCoords;
+    }
+};
+
+// Hashes the position/normal/texcoord bits of a vertex, used when welding shared corners
+struct VertexHash
+{
+    size_t operator()(const Vertex& vertex) const
+    {
+        const float* data = &vertex.Position.x;
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < sizeof(Vertex) / sizeof(float); i++) {
+            uint32_t bits;
+            memcpy(&bits, &data[i], sizeof(bits));
+            // treat -0.0f and 0.0f as the same key, since operator== does
+            if (bits == 0x80000000u)
+                bits = 0;
+            hash = (hash ^ bits) * 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+};
+
+// 16 byte vertex as stored in the vertex buffers:
+//  - Position: 16-bit unsigned normalized, relative to the mesh bounding box (w is padding)
+//  - Normal: signed normalized 10:10:10:2 (GL_INT_2_10_10_10_REV)
+//  - TexCoords: half floats
+struct PackedVertex
+{
+    GLushort Position[4];
+    GLuint Normal;
+    GLushort TexCoords[2];
+};
+
+// Most levels of detail a mesh can have, level 0 being the full mesh
+const int MAX_MESH_LODS = 4;
+
+// Range of the index buffer that draws one level of detail
+struct MeshLod
+{
+    GLuint indexOffset;
+    GLuint indexCount;
+};
+
+// Packed geometry of one mesh, ready for glBufferData. The shaders rebuild a position
+// as positionOffset + positionScale * Position.
+struct MeshGeometry
+{
+    const PackedVertex* vertices;
+    GLuint vertexCount;
+    // GL_UNSIGNED_SHORT when the mesh has fewer than 65536 vertices, else GL_UNSIGNED_INT
+    const void* indices;
+    GLuint indexCount;
+    GLenum indexType;
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    // levels of detail, all sharing the vertices
+    GLuint lodCount;
+    MeshLod lods[MAX_MESH_LODS];
+    // model space bounds of the full precision positions
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+};
+
+// Owning storage for packed geometry
+struct PackedMesh
+{
+    std::vector<PackedVertex> vertices;
+    std::vector<GLushort> shortIndices;
+    std::vector<GLuint> intIndices;
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    std::vector<MeshLod> lods;
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+
+    MeshGeometry GetGeometry() const;
+};
+
+// Bounding box of the positions, as the offset/scale they are quantized against
+void ComputeQuantizationBox(const std::vector<Vertex>& vertices, glm::vec3& positionOffset, glm::vec3& positionScale);
+
+// Quantizes vertices against the given box; positions outside of it are clamped
+void PackVertices(const std::vector<Vertex>& vertices, glm::vec3 positionOffset, glm::vec3 positionScale, std::vector<PackedVertex>& packed);
+
+// Box around the positions and a sphere around its center that encloses them
+void ComputeBounds(const std::vector<Vertex>& vertices, BoundingBox& box, BoundingSphere& sphere);
+
+// Quantizes a mesh to the packed layout, choosing the index size from the vertex count.
+// Without lods the whole index buffer is the only level of detail.
+PackedMesh PackMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::vector<MeshLod>& lods = std::vector<MeshLod>());
+
+// Appends the vertices of packed geometry quantized against another box, rounding each
+// position once from its stored value; normals and texture coordinates are copied as they are
+void RequantizeVertices(const MeshGeometry& geometry, glm::vec3 positionOffset, glm::vec3 positionScale, std::vector<PackedVertex>& packed);
+
+// Expands packed geometry back to full precision vertices and 32-bit indices
+void UnpackMesh(const MeshGeometry& geometry, std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+// Size in bytes of one index of the given type
+size_t IndexSize(GLenum indexType);
+
+}
+
+#endif /* VertexFormat_hpp */
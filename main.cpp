@@ -11,6 +11,14 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "SceneBvh.hpp"
+#include "StaticBatch.hpp"
+#include "ModelLoader.hpp"
+#include "GpuTimer.hpp"
+#include "OcclusionCuller.hpp"
+#include "ProgramCache.hpp"
+#include "ShadowCascades.hpp"
+#include "UniformBuffer.hpp"
 #include "SkyBox.hpp"
 
 #include <iostream>
@@ -21,8 +29,12 @@ int windowWidth = 1920;
 int windowHeight = 1080;
 int state = 0;
 
-const unsigned int SHADOW_WIDTH = 4096;
-const unsigned int SHADOW_HEIGHT = 4096;
+// shadow map resolution of every cascade, nearest first
+const GLsizei SHADOW_CASCADE_RESOLUTIONS[] = { 2048, 1024, 1024 };
+// shadows end this far from the camera - the fog has swallowed everything by then
+const float SHADOW_DISTANCE = 30.0f;
+// how far toward the light of a cascade objects can still cast into it
+const float SHADOW_CASTER_DISTANCE = 20.0f;
 
 std::vector<const GLchar*> faces;
 std::vector<const GLchar*> faces2;
@@ -31,6 +43,8 @@ std::vector<const GLchar*> faces2;
 glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
+// projection of the basic shaders - projection ends up holding the skybox one
+glm::mat4 sceneProjection;
 glm::mat3 normalMatrix;
 glm::mat4 lightRotation;
 glm::mat4 pointLightRotation;
@@ -40,14 +54,39 @@ glm::vec3 lightDir;
 glm::vec3 lightColor;
 glm::vec3 pointLightPos;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
-GLint pointLightPosLoc;
+// std140 mirror of FrameBlock in the shaders - camera, lights and shadow cascades
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    // mat3 columns are padded to vec4 in std140
+    glm::vec4 normalMatrix[3];
+    glm::vec4 lightDir;
+    glm::vec4 lightColor;
+    glm::vec4 pointLightPos;
+    glm::mat4 cascadeMatrices[gps::MAX_SHADOW_CASCADES];
+    glm::vec4 cascadeSplits;
+    glm::vec4 cascadeBias;
+    GLint cascadeCount;
+    GLint padding[3];
+};
+static_assert(sizeof(FrameUniforms) == 528, "FrameUniforms must match the std140 layout of FrameBlock");
+
+// std140 mirror of ObjectBlock in the shaders
+struct ObjectUniforms
+{
+    glm::mat4 model;
+    glm::vec4 modelNormalMatrix[3];
+};
+static_assert(sizeof(ObjectUniforms) == 112, "ObjectUniforms must match the std140 layout of ObjectBlock");
+
+const GLuint FRAME_BLOCK_BINDING = 0;
+const GLuint OBJECT_BLOCK_BINDING = 1;
+// slots of the object buffer - everything but the wheel moves with the scene matrix
+enum ObjectSlot { OBJECT_SCENE, OBJECT_WHEEL, OBJECT_SLOT_COUNT };
+// filled once per frame by updateFrameUniforms
+gps::UniformBuffer frameUniforms;
+gps::UniformBuffer objectUniforms;
 
 // camera
 gps::Camera myCamera(
@@ -71,26 +110,81 @@ gps::Model3D wheel;
 gps::Model3D fence;
 gps::Model3D trees;
 
+// static models merged into shared buffers, split by the refl flag they are drawn with
+gps::StaticBatch sceneryBatch;
+gps::StaticBatch reflectiveBatch;
+// --instanced-trees: draws the trees through Model3D::DrawInstanced with a single identity
+// instance instead of batching them, to exercise the instanced path on an unchanged scene
+bool instancedTrees;
+gps::InstanceBuffer treeInstances;
+
+// top level of the culling hierarchy, in the space of the scene model matrix; only the
+// wheel moves inside it
+enum SceneObject { SCENE_SCENERY, SCENE_TREES, SCENE_REFLECTIVE, SCENE_WHEEL, SCENE_CAR, SCENE_GLASS, SCENE_OBJECT_COUNT };
+// masks of SceneObject bits selecting what renderObjects draws
+const unsigned ALL_SCENE_OBJECTS = (1u << SCENE_OBJECT_COUNT) - 1;
+const unsigned DYNAMIC_SCENE_OBJECTS = 1u << SCENE_WHEEL;
+const unsigned STATIC_SCENE_OBJECTS = ALL_SCENE_OBJECTS & ~DYNAMIC_SCENE_OBJECTS;
+// the glass lets the light through
+const unsigned SHADOW_CASTING_OBJECTS = ALL_SCENE_OBJECTS & ~(1u << SCENE_GLASS);
+// everything that writes depth in the camera pass
+const unsigned OPAQUE_SCENE_OBJECTS = ALL_SCENE_OBJECTS & ~(1u << SCENE_GLASS);
+gps::SceneBvh sceneBvh;
+std::vector<gps::BoundingBox> sceneBoxes;
+std::vector<unsigned char> sceneVisible;
+
+// occlusion queries over the scene objects, one set per pass (O and U toggle them)
+gps::OcclusionCuller cameraOcclusion;
+gps::OcclusionCuller shadowOcclusion[gps::MAX_SHADOW_CASCADES];
+// never enabled - for draws that must not depend on last frame's queries (the static
+// shadow cache, the shading pass after the depth pre-pass)
+gps::OcclusionCuller noOcclusion;
+
 GLfloat angle;
 GLfloat angle2;
 GLfloat lightAngle;
 
 // shaders
-gps::Shader myBasicShader;
+// basic.vert/basic.frag specialized by the features below
+gps::ShaderVariants basicShaders;
+// the same for the instanced draws (basicInstanced.vert)
+gps::ShaderVariants basicInstancedShaders;
+enum BasicFeature { BASIC_POINT_LIGHT = 1, BASIC_REFLECTION = 2, BASIC_TRANSPARENT = 4 };
+// uniforms the scene sets outside the uniform blocks, by id (see gps::Shader::uniformId)
+const gps::UniformId LIGHT_SPACE_UNIFORM = gps::Shader::uniformId("lightSpaceTrMatrix");
+const gps::UniformId SHADOW_MAPS_UNIFORM = gps::Shader::uniformId("shadowMaps");
+const gps::UniformId SKYBOX_UNIFORM = gps::Shader::uniformId("skybox");
+// drawn with while a basic variant is still being built
+gps::Shader placeholderShader;
+// the shader load time is reported once every basic variant is ready
+double shaderLoadStart;
+bool shaderLoadReported;
 gps::Shader depthMapShader;
+gps::Shader depthPrepassShader;
+gps::Shader depthMapInstancedShader;
+gps::Shader depthPrepassInstancedShader;
 
 
 gps::SkyBox mySkyBox;
 gps::SkyBox mySkyBox2;
 gps::Shader skyboxShader;
 
-GLuint shadowMapFBO;
-GLuint depthMapTexture;
+gps::ShadowCascades shadowCascades;
+// copies the static shadow cache into the cascades
+gps::Shader shadowCacheCopyShader;
+// static shadow cache redraws since the last statistics line
+int shadowCacheUpdates;
 
 bool wireframeMode;
 bool lightOn;
 bool lightMode;
 bool animation;
+// prints the per-pass statistics once a second
+bool statsMode;
+// lays down the depth of the opaque objects before shading them with an EQUAL test (G toggles it)
+bool depthPrepass;
+gps::GpuTimer cameraPassTimer;
+double lastStatsTime;
 bool firstMouse = true;
 
 double lastTimeStamp = glfwGetTime();
@@ -155,6 +249,28 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         lightOn = !lightOn;
     }
 
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        cameraOcclusion.SetEnabled(!cameraOcclusion.IsEnabled());
+    }
+
+    if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        bool enabled = !shadowOcclusion[0].IsEnabled();
+        for (gps::OcclusionCuller& occlusion : shadowOcclusion)
+            occlusion.SetEnabled(enabled);
+    }
+
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        depthPrepass = !depthPrepass;
+    }
+
+    if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+        shadowCascades.SetStaticCaching(!shadowCascades.IsStaticCaching());
+    }
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        statsMode = !statsMode;
+    }
+
     if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
         if (animation) {
             myCamera.setPosition(glm::vec3(0.0f, 0.7f, 7.0f));
@@ -334,17 +450,26 @@ void initOpenGLState() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
-void initModels() {
-    car.LoadModel("models/car/car.obj");
-    glass.LoadModel("models/car/glass.obj");
-    road.LoadModel("models/road/road.obj");
-    cabin.LoadModel("models/cabin/cabin.obj");
-    ground.LoadModel("models/ground/ground.obj");
-    lamp.LoadModel("models/lamp/lamp.obj");
-    windmill.LoadModel("models/windmill/windmill.obj");
-    wheel.LoadModel("models/windmill/wheel.obj");
-    fence.LoadModel("models/fence/fence.obj");
-    trees.LoadModel("models/trees/trees.obj");
+bool initModels() {
+    double loadStart = glfwGetTime();
+
+    // merged into the static batches - their meshes get no buffers of their own
+    gps::Model3D* staticModels[] = { &road, &ground, &cabin, &fence, &trees, &lamp, &windmill };
+    for (gps::Model3D* staticModel : staticModels)
+        staticModel->SetBatched(staticModel != &trees || !instancedTrees);
+
+    // parse on the worker pool, upload here on the GL thread
+    gps::ModelLoader loader;
+    loader.Add(car, "models/car/car.obj");
+    loader.Add(glass, "models/car/glass.obj");
+    loader.Add(road, "models/road/road.obj");
+    loader.Add(cabin, "models/cabin/cabin.obj");
+    loader.Add(ground, "models/ground/ground.obj");
+    loader.Add(lamp, "models/lamp/lamp.obj");
+    loader.Add(windmill, "models/windmill/windmill.obj");
+    loader.Add(wheel, "models/windmill/wheel.obj");
+    loader.Add(fence, "models/fence/fence.obj");
+    loader.Add(trees, "models/trees/trees.obj");
 
     faces.push_back("models/skybox/right.tga");
     faces.push_back("models/skybox/left.tga");
@@ -352,7 +477,7 @@ void initModels() {
     faces.push_back("models/skybox/bottom.tga");
     faces.push_back("models/skybox/back.tga");
     faces.push_back("models/skybox/front.tga");
-    mySkyBox.Load(faces);
+    loader.Add(mySkyBox, faces);
 
     faces2.push_back("models/skybox2/right.tga");
     faces2.push_back("models/skybox2/left.tga");
@@ -360,254 +485,528 @@ void initModels() {
     faces2.push_back("models/skybox2/bottom.tga");
     faces2.push_back("models/skybox2/back.tga");
     faces2.push_back("models/skybox2/front.tga");
+    loader.Add(mySkyBox2, faces2);
 
-    mySkyBox2.Load(faces2);
+    if (!loader.Finish()) {
+        std::cerr << "ERROR: could not load the models" << std::endl;
+        return false;
+    }
+
+    sceneryBatch.Add(road);
+    sceneryBatch.Add(ground);
+    sceneryBatch.Add(cabin);
+    sceneryBatch.Add(fence);
+    if (!instancedTrees)
+        sceneryBatch.Add(trees);
+    sceneryBatch.Build();
+    reflectiveBatch.Add(lamp);
+    reflectiveBatch.Add(windmill);
+    reflectiveBatch.Build();
+    for (gps::Model3D* staticModel : staticModels)
+        staticModel->ReleaseBatchMeshes();
+    glass.SetCastsShadows(false);
+
+    sceneBoxes.resize(SCENE_OBJECT_COUNT);
+    sceneBoxes[SCENE_SCENERY] = sceneryBatch.GetBoundingBox();
+    sceneBoxes[SCENE_REFLECTIVE] = reflectiveBatch.GetBoundingBox();
+    if (instancedTrees) {
+        treeInstances.Update(std::vector<glm::mat4>(1, glm::mat4(1.0f)));
+        sceneBoxes[SCENE_TREES] = trees.GetBoundingBox();
+    }
+
+    sceneBoxes[SCENE_WHEEL] = wheel.GetBoundingBox();
+    sceneBoxes[SCENE_CAR] = car.GetBoundingBox();
+    sceneBoxes[SCENE_GLASS] = glass.GetBoundingBox();
+    sceneBvh.Build(sceneBoxes);
+
+    std::cout << "Models loaded in " << (glfwGetTime() - loadStart) * 1000.0 << " ms" << std::endl;
+
+    return true;
 }
 
+// Issues every compile and link up front; only the small programs every frame needs are
+// waited for, the basic variants finish in the background (see reportShaderLoad)
 void initShaders() {
-	myBasicShader.loadShader("shaders/basic.vert", "shaders/basic.frag");
-    depthMapShader.loadShader("shaders/depthMap.vert", "shaders/depthMap.frag");
-    skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
+    shaderLoadStart = glfwGetTime();
+    gps::ProgramCache::ResetStats();
+    gps::Shader::bindUniformBlock("FrameBlock", FRAME_BLOCK_BINDING);
+    gps::Shader::bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING);
+    bool parallel = gps::Shader::initParallelCompile();
+    std::cout << "Parallel shader compile : " << (parallel ? "yes" : "no") << std::endl;
+
+    placeholderShader.loadShader("shaders/placeholder.vert", "shaders/placeholder.frag");
+
+    basicShaders.Load("shaders/basic.vert", "shaders/basic.frag", { "POINT_LIGHT", "REFLECTION", "TRANSPARENT" });
+    // the variants the scene draws with
+    const gps::ShaderVariantKey used[] = { 0, BASIC_REFLECTION, BASIC_REFLECTION | BASIC_TRANSPARENT };
+    for (gps::ShaderVariantKey key : used) {
+        basicShaders.BeginLoad(key);
+        basicShaders.BeginLoad(key | BASIC_POINT_LIGHT);
+    }
+    basicInstancedShaders.Load("shaders/basicInstanced.vert", "shaders/basic.frag", { "POINT_LIGHT", "REFLECTION", "TRANSPARENT" });
+    basicInstancedShaders.BeginLoad(0);
+    basicInstancedShaders.BeginLoad(BASIC_POINT_LIGHT);
+    depthMapShader.beginLoad("shaders/depthMap.vert", "shaders/depthMap.frag", {});
+    depthPrepassShader.beginLoad("shaders/depthPrepass.vert", "shaders/depthMap.frag", {});
+    depthMapInstancedShader.beginLoad("shaders/depthMapInstanced.vert", "shaders/depthMap.frag", {});
+    depthPrepassInstancedShader.beginLoad("shaders/depthPrepassInstanced.vert", "shaders/depthMap.frag", {});
+    skyboxShader.beginLoad("shaders/skyboxShader.vert", "shaders/skyboxShader.frag", {});
+    shadowCacheCopyShader.beginLoad("shaders/shadowCacheCopy.vert", "shaders/shadowCacheCopy.frag", {});
+
+    depthMapShader.finishLoad();
+    depthPrepassShader.finishLoad();
+    depthMapInstancedShader.finishLoad();
+    depthPrepassInstancedShader.finishLoad();
+    skyboxShader.finishLoad();
+    shadowCacheCopyShader.finishLoad();
 }
 
-void initUniforms() {
-    myBasicShader.useShaderProgram();
+// Prints how long the shaders took once the last basic variant is ready
+void reportShaderLoad() {
+    if (shaderLoadReported || basicShaders.GetPendingCount() + basicInstancedShaders.GetPendingCount() > 0)
+        return;
+    shaderLoadReported = true;
+
+    // cold when everything was compiled from source, warm when it all came from the binaries
+    const gps::ProgramCacheStats& programStats = gps::ProgramCache::GetStats();
+    const char* start = programStats.compiled == 0 ? "warm" : (programStats.loaded == 0 ? "cold" : "partly warm");
+    std::cout << "Shaders loaded in " << (glfwGetTime() - shaderLoadStart) * 1000.0 << " ms (" << start << " start, "
+        << basicShaders.GetCompiledCount() + basicInstancedShaders.GetCompiledCount() << " basic variants, " << programStats.loaded << " programs from the binary cache, "
+        << programStats.compiled << " compiled)" << std::endl;
+}
 
+// the shaders read the matrices and lights from the uniform buffers, see updateFrameUniforms
+void initUniforms() {
     // create model matrix for teapot
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
     // get view matrix for current camera
     view = myCamera.getViewMatrix();
-    viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-    // send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
-    view = myCamera.getViewMatrix();
     glCheckError();
-    glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "view"), 1, GL_FALSE,
-        glm::value_ptr(view));
 
     // compute normal matrix for teapot
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
     // create projection matrix
     projection = glm::perspective(glm::radians(45.0f),
         (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
         0.1f, 200.0f);
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    // send projection matrix to shader
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    sceneProjection = projection;
     
+    // the sky only takes the directions from it
     projection = glm::perspective(glm::radians(45.0f), (float)windowWidth / (float)windowHeight, 0.1f, 1000.0f);
-    glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE,
-        glm::value_ptr(projection));
 
 
     //set the light direction (direction towards the light)
     lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-    lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-    // send light dir to shader
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
     
     //set light color
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-    lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-    // send light color to shader
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
     
     pointLightPos = glm::vec3(1.3f, 0.96f, 0.65f);
-    pointLightPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightPos");
-    glUniform3fv(pointLightPosLoc, 1, glm::value_ptr(pointLightPos));
 
+    frameUniforms.Create(FRAME_BLOCK_BINDING, sizeof(FrameUniforms), 1);
+    objectUniforms.Create(OBJECT_BLOCK_BINDING, sizeof(ObjectUniforms), OBJECT_SLOT_COUNT);
+}
+
+// Fits the cascades to the current camera; updateFrameUniforms passes them on to the shaders
+void updateShadowCascades() {
+    shadowCascades.Update(view, glm::radians(45.0f), (float)windowWidth / (float)windowHeight, 0.1f, lightDir);
 }
 
 void initFBO() {
-    //TODO - Create the FBO, the depth texture and attach the depth texture to the FBO
-    glGenFramebuffers(1, &shadowMapFBO);
+    std::vector<GLsizei> resolutions(std::begin(SHADOW_CASCADE_RESOLUTIONS), std::end(SHADOW_CASCADE_RESOLUTIONS));
+    shadowCascades.Create(resolutions, SHADOW_DISTANCE, SHADOW_CASTER_DISTANCE);
+    shadowCascades.SetStaticCaching(true);
+    // sizes the static caches, so they are counted below
+    updateShadowCascades();
+    std::cout << "Shadow maps : " << shadowCascades.GetCascadeCount() << " cascades, "
+        << shadowCascades.GetMemoryBytes() / (1024 * 1024) << " MB" << std::endl;
+}
 
-    //create depth texture for FBO
-    glGenTextures(1, &depthMapTexture);
-    glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-        SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+float movementSpeed = 100; // units per second 
+void updateAngle(double elapsedSeconds) { 
+    angle2 = angle2 + movementSpeed * elapsedSeconds; 
+} 
 
-    //attach texture to FBO
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
+// Transform of the windmill wheel relative to the rest of the scene
+glm::mat4 computeWheelTransform() {
+    glm::mat4 wheelTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.528f, -5.237f));
+    wheelTransform = glm::rotate(wheelTransform, glm::radians(angle2), glm::vec3(1.0f, 0.0f, 0.0f));
+    wheelTransform = glm::translate(wheelTransform, glm::vec3(0.0f, -2.528f, 5.237f));
+    return wheelTransform;
+}
 
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
+// Queries the scene hierarchy with the current cull frustum, after refitting the wheel
+void cullSceneObjects(const glm::mat4& wheelTransform) {
+    sceneBoxes[SCENE_WHEEL] = gps::TransformBox(wheel.GetBoundingBox(), wheelTransform);
+    sceneBvh.SetItemBox(SCENE_WHEEL, sceneBoxes[SCENE_WHEEL]);
+    sceneBvh.Refit();
+    // the hierarchy is built in the space of the scene model matrix
+    sceneBvh.QueryFrustum(gps::Model3D::GetCullFrustum().Transformed(model), sceneVisible);
+    // otherwise the trees are part of the scenery batch
+    if (!instancedTrees)
+        sceneVisible[SCENE_TREES] = 0;
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Sky of the current light mode
+gps::SkyBox& currentSkyBox() {
+    return lightMode ? mySkyBox2 : mySkyBox;
+}
 
+// Color of the directional light in the current light mode
+glm::vec3 currentLightColor() {
+    return lightMode ? glm::vec3(0.003f, 0.003f, 0.003f) : lightColor;
 }
 
-glm::mat4 computeLightSpaceTrMatrix() {
-    //TODO - Return the light-space transformation matrix
-    lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 lightView = glm::lookAt(lightDir, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+// Basic shader variant with the given features (plus the point light when it is on), or the
+// placeholder while it is being built
+gps::Shader& basicVariant(gps::ShaderVariantKey features, gps::ShaderVariants& variants = basicShaders) {
+    if (lightOn)
+        features |= BASIC_POINT_LIGHT;
+    gps::Shader& shader = variants.GetReady(features, placeholderShader);
+    shader.useShaderProgram();
 
-    const GLfloat near_plane = -15.0f, far_plane = 15.0f;
-    glm::mat4 lightProjection = glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, near_plane, far_plane);
+    // the cascades always sit on texture units 3 and up, the sky on 7 - only uploaded the
+    // first time, the setters skip values the program already holds
+    GLint shadowUnits[gps::MAX_SHADOW_CASCADES];
+    for (int i = 0; i < gps::MAX_SHADOW_CASCADES; i++)
+        shadowUnits[i] = 3 + i;
+    shader.setUniformArray(SHADOW_MAPS_UNIFORM, shadowUnits, gps::MAX_SHADOW_CASCADES);
+    shader.setUniform(SKYBOX_UNIFORM, 7);
+    return shader;
+}
 
-    glm::mat4 lightSpaceTrMatrix = lightProjection * lightView * lightRotation;
+// Basic variant for one scene object, with the object block pointed at its slot
+gps::Shader& basicObjectShader(gps::ShaderVariantKey features, ObjectSlot slot, gps::ShaderVariants& variants = basicShaders) {
+    objectUniforms.Bind(slot);
+    return basicVariant(features, variants);
+}
 
-    return lightSpaceTrMatrix;
+// Program that draws one scene object: the pass shader in the depth-only passes, else the
+// basic variant with the features the object needs
+gps::Shader& objectShader(gps::Shader& shader, bool pass, gps::ShaderVariantKey features, ObjectSlot slot,
+    gps::ShaderVariants& variants = basicShaders) {
+    if (!pass)
+        return basicObjectShader(features, slot, variants);
+    objectUniforms.Bind(slot);
+    shader.useShaderProgram();
+    return shader;
 }
 
-float movementSpeed = 100; // units per second 
-void updateAngle(double elapsedSeconds) { 
-    angle2 = angle2 + movementSpeed * elapsedSeconds; 
-} 
+// Packs a mat3 into the vec4 columns std140 gives it
+void packMat3(const glm::mat3& matrix, glm::vec4 columns[3]) {
+    for (int i = 0; i < 3; i++)
+        columns[i] = glm::vec4(matrix[i], 0.0f);
+}
 
-void renderObjects(gps::Shader shader, bool pass) {
-    // select active shader program
-    shader.useShaderProgram();
-    
+// Fills and uploads the frame and object blocks, once per frame after the camera, the
+// lights and the cascades have been updated
+void updateFrameUniforms() {
+    glm::mat4 sceneModel = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    normalMatrix = glm::mat3(glm::inverseTranspose(view * sceneModel));
+
+    FrameUniforms frame;
+    frame.view = view;
+    frame.projection = sceneProjection;
+    packMat3(normalMatrix, frame.normalMatrix);
+    frame.lightDir = glm::vec4(lightDir, 0.0f);
+    frame.lightColor = glm::vec4(currentLightColor(), 0.0f);
+    frame.pointLightPos = sceneModel * glm::vec4(pointLightPos, 1.0f);
+    frame.cascadeSplits = glm::vec4(0.0f);
+    frame.cascadeBias = glm::vec4(0.0f);
+    frame.cascadeCount = shadowCascades.GetCascadeCount();
+    for (int i = 0; i < frame.cascadeCount; i++) {
+        frame.cascadeMatrices[i] = shadowCascades.GetLightSpaceMatrix(i);
+        frame.cascadeSplits[i] = shadowCascades.GetSplitDistance(i);
+        frame.cascadeBias[i] = shadowCascades.GetDepthBias(i);
+    }
+    frameUniforms.Write(0, &frame);
+    frameUniforms.Upload();
+    frameUniforms.Bind(0);
+
+    // the normals need the inverse transpose, done here once instead of per vertex
+    const glm::mat4 objectModels[OBJECT_SLOT_COUNT] = { sceneModel, sceneModel * computeWheelTransform() };
+    for (int i = 0; i < OBJECT_SLOT_COUNT; i++) {
+        ObjectUniforms object;
+        object.model = objectModels[i];
+        packMat3(glm::mat3(glm::inverseTranspose(objectModels[i])), object.modelNormalMatrix);
+        objectUniforms.Write(i, &object);
+    }
+    objectUniforms.Upload();
+}
+
+// Advances the wheel animation - once per frame, every pass draws the same pose
+void updateAnimation() {
+    double currentTimeStamp = glfwGetTime();
+    updateAngle(currentTimeStamp - lastTimeStamp);
+    lastTimeStamp = currentTimeStamp;
+}
+
+// Draws the scene objects in the objects mask for one pass; viewProjection is what the
+// occlusion boxes are tested with. The depth-only passes (pass true) draw everything with
+// shader and the instanced trees with instancedShader, the camera pass gives every object
+// the basic variant it needs.
+void renderObjects(gps::Shader& shader, gps::Shader& instancedShader, bool pass, gps::OcclusionCuller& occlusion,
+    const glm::mat4& viewProjection, unsigned objects = ALL_SCENE_OBJECTS) {
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+
+    glm::mat4 wheelTransform = computeWheelTransform();
+    glm::mat4 model1 = model * wheelTransform;
+    cullSceneObjects(wheelTransform);
+    for (int i = 0; i < SCENE_OBJECT_COUNT; i++) {
+        if (!(objects & (1u << i)))
+            sceneVisible[i] = 0;
+    }
+
+    occlusion.BeginFrame(SCENE_OBJECT_COUNT);
 
     if (!pass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-        glUniform3fv(pointLightPosLoc, 1, glm::value_ptr(glm::vec3(model * glm::vec4(pointLightPos, 1.0f))));
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "lightOn"), lightOn);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "refl"), false);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "transparent"), false);
-    }
-
-    if (lightMode)
-        mySkyBox2.Draw(skyboxShader, view, projection);
-    else
-        mySkyBox.Draw(skyboxShader, view, projection);
-
-    road.Draw(shader);
-    ground.Draw(shader);
-    cabin.Draw(shader);
-    fence.Draw(shader);
-    trees.Draw(shader);
-    
-    if (!pass) {
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "refl"), true);
+        // reflections read the sky from a unit of its own, after the shadow cascades
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, currentSkyBox().GetTextureId());
     }
 
-    lamp.Draw(shader);
-    windmill.Draw(shader);
+    if (sceneVisible[SCENE_SCENERY]) {
+        occlusion.BeginItem(SCENE_SCENERY);
+        sceneryBatch.Draw(objectShader(shader, pass, 0, OBJECT_SCENE), model);
+        occlusion.EndItem();
+    }
 
-    double currentTimeStamp = glfwGetTime(); 
-    updateAngle(currentTimeStamp - lastTimeStamp); 
-    lastTimeStamp = currentTimeStamp;
+    if (sceneVisible[SCENE_TREES]) {
+        occlusion.BeginItem(SCENE_TREES);
+        // the instance at the detail of the pass bias, as DrawInstanced does no LOD selection
+        trees.DrawInstanced(objectShader(instancedShader, pass, 0, OBJECT_SCENE, basicInstancedShaders), treeInstances,
+            treeInstances.getCount(), gps::Model3D::GetLodView().bias);
+        occlusion.EndItem();
+    }
+
+    if (sceneVisible[SCENE_REFLECTIVE]) {
+        occlusion.BeginItem(SCENE_REFLECTIVE);
+        reflectiveBatch.Draw(objectShader(shader, pass, BASIC_REFLECTION, OBJECT_SCENE), model);
+        occlusion.EndItem();
+    }
+
+    if (sceneVisible[SCENE_WHEEL]) {
+        occlusion.BeginItem(SCENE_WHEEL);
+        wheel.Draw(objectShader(shader, pass, BASIC_REFLECTION, OBJECT_WHEEL), model1);
+        occlusion.EndItem();
+    }
 
-    glm::mat4 model1 = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    model1 = glm::translate(model1, glm::vec3(0.0f, 2.528f, -5.237f));
-    model1 = glm::rotate(model1, glm::radians(angle2), glm::vec3(1.0f, 0.0f, 0.0f));
-    model1 = glm::translate(model1, glm::vec3(0.0f, -2.528f, 5.237f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model1));
-    wheel.Draw(shader);
-    
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
     glDisable(GL_CULL_FACE);
-    car.Draw(shader);
+    if (sceneVisible[SCENE_CAR]) {
+        occlusion.BeginItem(SCENE_CAR);
+        car.Draw(objectShader(shader, pass, BASIC_REFLECTION, OBJECT_SCENE), model);
+        occlusion.EndItem();
+    }
 
+    // after the opaque geometry, so early-Z rejects the sky behind it; before the glass
+    // that blends over it. The shadow pass has no sky.
     if (!pass) {
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "transparent"), true);
+        // the glass is not in the depth pre-pass, it is tested and written as usual
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        currentSkyBox().Draw(skyboxShader, view, projection);
     }
 
-    glass.Draw(shader);
+    if (sceneVisible[SCENE_GLASS]) {
+        occlusion.BeginItem(SCENE_GLASS);
+        glass.Draw(objectShader(shader, pass, BASIC_REFLECTION | BASIC_TRANSPARENT, OBJECT_SCENE), model);
+        occlusion.EndItem();
+    }
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
-}
 
-void renderObjects2(gps::Shader shader) {
-    shader.useShaderProgram();
+    // the boxes are tested against everything drawn above, for the next frame
+    objectUniforms.Bind(OBJECT_SCENE);
+    occlusion.IssueQueries(depthMapShader, viewProjection, model, sceneBoxes, sceneVisible);
+}
 
+// Wireframe view - only the edges count, so everything goes through the plain variant
+void renderObjects2() {
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
+    glm::mat4 wheelTransform = computeWheelTransform();
+    glm::mat4 model1 = model * wheelTransform;
+    cullSceneObjects(wheelTransform);
+
+    if (sceneVisible[SCENE_SCENERY])
+        sceneryBatch.Draw(basicObjectShader(0, OBJECT_SCENE), model);
+    if (sceneVisible[SCENE_TREES])
+        trees.DrawInstanced(basicObjectShader(0, OBJECT_SCENE, basicInstancedShaders), treeInstances, treeInstances.getCount());
+    if (sceneVisible[SCENE_REFLECTIVE])
+        reflectiveBatch.Draw(basicObjectShader(0, OBJECT_SCENE), model);
+
+    if (sceneVisible[SCENE_WHEEL])
+        wheel.Draw(basicObjectShader(0, OBJECT_WHEEL), model1);
+
+    if (sceneVisible[SCENE_CAR])
+        car.Draw(basicObjectShader(0, OBJECT_SCENE), model);
     mySkyBox.Draw(skyboxShader, view, projection);
-    ground.Draw(shader);
-    road.Draw(shader);
-    cabin.Draw(shader);
-    fence.Draw(shader);
-    trees.Draw(shader);
-    lamp.Draw(shader);
-    windmill.Draw(shader);
+    if (sceneVisible[SCENE_GLASS])
+        glass.Draw(basicObjectShader(0, OBJECT_SCENE), model);
+}
 
-    double currentTimeStamp = glfwGetTime();
-    updateAngle(currentTimeStamp - lastTimeStamp);
-    lastTimeStamp = currentTimeStamp;
-    glm::mat4 model1 = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    model1 = glm::translate(model1, glm::vec3(0.0f, 2.528f, -5.237f));
-    model1 = glm::rotate(model1, glm::radians(angle2), glm::vec3(1.0f, 0.0f, 0.0f));
-    model1 = glm::translate(model1, glm::vec3(0.0f, -2.528f, 5.237f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model1));
-    wheel.Draw(shader);
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+// Level of detail selection for the camera pass
+gps::LodView cameraLodView() {
+    gps::LodView lodView;
+    lodView.eyePosition = myCamera.getPosition();
+    // projection[1][1] is cot(fov / 2), so this maps a world size at distance 1 to pixels
+    lodView.pixelsPerUnit = windowHeight * 0.5f * projection[1][1];
+    lodView.orthographic = false;
+    lodView.bias = 0;
+    return lodView;
+}
+
+// Light space matrix of the depth-only shadow programs
+void setShadowPassMatrix(const glm::mat4& lightSpaceTrMatrix) {
+    depthMapShader.setUniform(LIGHT_SPACE_UNIFORM, lightSpaceTrMatrix);
+    depthMapInstancedShader.setUniform(LIGHT_SPACE_UNIFORM, lightSpaceTrMatrix);
+}
 
-    car.Draw(shader);
-    glass.Draw(shader);
+// Level of detail selection for one shadow cascade
+gps::LodView shadowLodView(int cascade) {
+    gps::LodView lodView;
+    lodView.eyePosition = glm::vec3(0.0f);
+    lodView.pixelsPerUnit = shadowCascades.GetResolution(cascade) / shadowCascades.GetWidth(cascade);
+    lodView.orthographic = true;
+    // shadow casters get away with one level coarser than their footprint suggests
+    lodView.bias = 1;
+    return lodView;
+}
+
+void printStats() {
+    double now = glfwGetTime();
+    if (!statsMode || now - lastStatsTime < 1.0)
+        return;
+    lastStatsTime = now;
+
+    const gps::CullingStats& culling = gps::GetCullingStats();
+    std::cout << "Frustum culling : " << culling.culled << " of " << culling.tested << " objects culled, "
+        << culling.nodesVisited << " BVH nodes visited" << std::endl;
+
+    for (int i = 0; i <= shadowCascades.GetCascadeCount(); i++) {
+        // the cascades first, then the camera
+        bool camera = i == shadowCascades.GetCascadeCount();
+        const gps::OcclusionCuller& occlusion = camera ? cameraOcclusion : shadowOcclusion[i];
+        if (!occlusion.IsEnabled())
+            continue;
+        const gps::OcclusionStats& occlusionStats = occlusion.GetStats();
+        std::cout << "Occlusion culling (";
+        if (camera)
+            std::cout << "camera";
+        else
+            std::cout << "cascade " << i;
+        std::cout << ") : " << occlusionStats.occluded << " of "
+            << occlusionStats.queried << " queried objects occluded" << std::endl;
+    }
+
+    if (shadowCascades.IsStaticCaching())
+        std::cout << "Shadow cache : " << shadowCacheUpdates << " cascade redraws" << std::endl;
+
+    std::cout << "Camera pass : " << cameraPassTimer.GetMilliseconds() << " ms GPU, depth pre-pass "
+        << (depthPrepass ? "on" : "off") << std::endl;
+
+    const gps::UniformStats& uniformStats = gps::Shader::getUniformStats();
+    std::cout << "Uniforms : " << uniformStats.uploaded << " uploaded, " << uniformStats.skipped
+        << " unchanged skipped since the last line" << std::endl;
+    gps::Shader::resetUniformStats();
+    shadowCacheUpdates = 0;
 }
 
 void renderScene() {
+    updateAnimation();
+    reportShaderLoad();
+
     if (wireframeMode) {
         glViewport(0, 0, windowWidth, windowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        myBasicShader.useShaderProgram();
         view = myCamera.getViewMatrix();
-        glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        updateFrameUniforms();
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        renderObjects2(myBasicShader);
+        gps::Model3D::SetLodView(cameraLodView());
+        gps::Model3D::SetCullFrustum(gps::Frustum::FromMatrix(sceneProjection * view));
+        gps::ResetCullingStats();
+        renderObjects2();
+        printStats();
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
     else {
-
-        if(lightMode)
-            glUniform3fv(lightColorLoc, 1, glm::value_ptr(glm::vec3(0.003f, 0.003f, 0.003f)));
-        else
-            glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
         lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
         lightDir = glm::vec3(glm::mat3(lightRotation) * lightDir);
         lightAngle = 0;
 
-        depthMapShader.useShaderProgram();
-        glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
-            1,
-            GL_FALSE,
-            glm::value_ptr(computeLightSpaceTrMatrix()));
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        renderObjects(depthMapShader, true);
+        // the cascades follow the camera, so they are fitted to this frame's view
+        view = myCamera.getViewMatrix();
+        updateShadowCascades();
+        updateFrameUniforms();
+
+        for (int i = 0; i < shadowCascades.GetCascadeCount(); i++) {
+            glm::mat4 lightSpaceTrMatrix = shadowCascades.GetLightSpaceMatrix(i);
+            gps::Model3D::SetLodView(shadowLodView(i));
+            gps::Model3D::SetShadowPass(true);
+
+            if (!shadowCascades.HasStaticCache(i)) {
+                setShadowPassMatrix(lightSpaceTrMatrix);
+                gps::Model3D::SetCullFrustum(shadowCascades.GetCasterFrustum(i));
+                shadowCascades.BeginCascade(i, shadowCacheCopyShader);
+                renderObjects(depthMapShader, depthMapInstancedShader, true, shadowOcclusion[i], lightSpaceTrMatrix, SHADOW_CASTING_OBJECTS);
+                continue;
+            }
+
+            // the static casters are only drawn again when the cascade left the static light box,
+            // the light turned or the scene rotated; every frame starts from their depth and adds
+            // the moving ones
+            glm::mat4 sceneModel = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+            if (shadowCascades.NeedsStaticUpdate(i, sceneModel)) {
+                // the cache outlives camera moves, so it holds everything in its light box
+                glm::mat4 staticLightSpaceMatrix = shadowCascades.GetStaticLightSpaceMatrix(i);
+                setShadowPassMatrix(staticLightSpaceMatrix);
+                gps::Model3D::SetCullFrustum(gps::Frustum::FromMatrix(staticLightSpaceMatrix));
+                shadowCascades.BeginStaticCascade(i, sceneModel);
+                renderObjects(depthMapShader, depthMapInstancedShader, true, noOcclusion, staticLightSpaceMatrix, STATIC_SCENE_OBJECTS & SHADOW_CASTING_OBJECTS);
+                shadowCacheUpdates++;
+            }
+            setShadowPassMatrix(lightSpaceTrMatrix);
+            gps::Model3D::SetCullFrustum(shadowCascades.GetCasterFrustum(i));
+            shadowCascades.BeginCascade(i, shadowCacheCopyShader);
+            renderObjects(depthMapShader, depthMapInstancedShader, true, shadowOcclusion[i], lightSpaceTrMatrix, DYNAMIC_SCENE_OBJECTS & SHADOW_CASTING_OBJECTS);
+        }
+        gps::Model3D::SetShadowPass(false);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         glViewport(0, 0, windowWidth, windowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        myBasicShader.useShaderProgram();
-        view = myCamera.getViewMatrix();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
-        glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
-
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap"), 3);
-
-        glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceTrMatrix"),
-            1,
-            GL_FALSE,
-            glm::value_ptr(computeLightSpaceTrMatrix()));
+        for (int i = 0; i < shadowCascades.GetCascadeCount(); i++) {
+            glActiveTexture(GL_TEXTURE3 + i);
+            glBindTexture(GL_TEXTURE_2D, shadowCascades.GetDepthTexture(i));
+        }
 
-        renderObjects(myBasicShader, false);
+        gps::Model3D::SetLodView(cameraLodView());
+        gps::Model3D::SetCullFrustum(gps::Frustum::FromMatrix(sceneProjection * view));
+        gps::ResetCullingStats();
+        cameraPassTimer.Begin();
+        if (depthPrepass) {
+            // the occlusion queries go with the pass that builds the depth buffer
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            renderObjects(depthPrepassShader, depthPrepassInstancedShader, true, cameraOcclusion, sceneProjection * view, OPAQUE_SCENE_OBJECTS);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            // every pixel is shaded once, by the surface that won the pre-pass
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+            renderObjects(basicVariant(0), basicVariant(0, basicInstancedShaders), false, noOcclusion, sceneProjection * view);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+        }
+        else {
+            renderObjects(basicVariant(0), basicVariant(0, basicInstancedShaders), false, cameraOcclusion, sceneProjection * view);
+        }
+        cameraPassTimer.End();
+        printStats();
     }
 }
 
@@ -618,6 +1017,12 @@ void cleanup() {
 
 int main(int argc, const char * argv[]) {
 
+    if (argc > 1 && std::string(argv[1]) == "--bvh-benchmark") {
+        gps::SceneBvh::Benchmark(argc > 2 ? (size_t)atol(argv[2]) : 100000);
+        return EXIT_SUCCESS;
+    }
+    instancedTrees = argc > 1 && std::string(argv[1]) == "--instanced-trees";
+
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
@@ -626,7 +1031,10 @@ int main(int argc, const char * argv[]) {
     }
 
     initOpenGLState();
-	initModels();
+	if (!initModels()) {
+		cleanup();
+		return EXIT_FAILURE;
+	}
 	initShaders();
 	initUniforms();
     initFBO();
@@ -1,29 +1,38 @@
 #version 410 core
 
+//variants (ShaderVariants features): POINT_LIGHT, REFLECTION, TRANSPARENT
+
 in vec3 fPosition;
+in vec3 fPosEye;
 in vec3 fNormal;
 in vec2 fTexCoords;
-in vec4 fragPosLightSpace;
 
 out vec4 fColor;
 
-//booleans
-uniform bool lightOn;
-uniform bool transparent;
-uniform bool refl;
-//matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat3 normalMatrix;
-//lighting
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-uniform vec3 pointLightPos;
+//per-frame camera and light data, shared by every program (FrameUniforms in main.cpp)
+layout(std140) uniform FrameBlock
+{
+    mat4 view;
+    mat4 projection;
+    mat3 normalMatrix;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 pointLightPos;
+    //cascaded shadow maps, nearest cascade first
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    int cascadeCount;
+};
 //textures
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
+#ifdef REFLECTION
 uniform samplerCube skybox;
+#endif
+//cascaded shadow maps, the matrices and splits are in FrameBlock
+const int MAX_SHADOW_CASCADES = 4;
+uniform sampler2D shadowMaps[MAX_SHADOW_CASCADES];
 
 //components
 vec3 ambient;
@@ -32,19 +41,36 @@ vec3 diffuse;
 vec3 specular;
 float specularStrength = 0.95f;
 
+float sampleShadowMap(int cascade, vec2 coords)
+{
+	//sampler arrays may only be indexed with constants here
+	if (cascade == 0) return texture(shadowMaps[0], coords).r;
+	if (cascade == 1) return texture(shadowMaps[1], coords).r;
+	if (cascade == 2) return texture(shadowMaps[2], coords).r;
+	return texture(shadowMaps[3], coords).r;
+}
+
 float computeShadow()
 {
+	//the first cascade whose slice reaches past the fragment
+	float viewDepth = -fPosEye.z;
+	int cascade = 0;
+	while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade])
+		cascade++;
+	if (cascade == cascadeCount) return 0.0f;
+
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fPosition, 1.0f);
 	vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
 
 	normalizedCoords = normalizedCoords * 0.5 + 0.5;
 	
 	if (normalizedCoords.z > 1.0f) return 0.0f;
 
-	float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
+	float closestDepth = sampleShadowMap(cascade, normalizedCoords.xy);
 
 	float currentDepth = normalizedCoords.z;
 
-	float bias = 0.005;
+	float bias = cascadeBias[cascade];
 	float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
 	
 	return shadow;
@@ -52,15 +78,13 @@ float computeShadow()
 
 vec3 computeDirLight(float shadow)
 {
-    //compute eye space coordinates
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
     vec3 normalEye = normalize(normalMatrix * fNormal);
 
     //normalize light direction
     vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
 
     //compute view direction (in eye coordinates, the viewer is situated at the origin
-    vec3 viewDir = normalize(- fPosEye.xyz);
+    vec3 viewDir = normalize(- fPosEye);
 
     //compute ambient light
     ambient = ambientStrength * lightColor;
@@ -76,10 +100,9 @@ vec3 computeDirLight(float shadow)
     return min((ambient + (1.0f - shadow)*diffuse) * texture(diffuseTexture, fTexCoords).rgb + (1.0f - shadow) * specular * texture(specularTexture, fTexCoords).rgb, 1.0f);
 }
 
+#ifdef POINT_LIGHT
 vec3 computePointLight()
 {
-    vec4 fragPosEye = view * model * vec4(fPosition, 1.0f);
-    //vec3 lightPosEye = view * model * pointLightPos;
     vec3 lightDirN = normalize(pointLightPos - fPosition);
     //vec3 normalEye = normalize(fNormal);
     float constant = 1.0f;
@@ -93,7 +116,7 @@ vec3 computePointLight()
     float att = 1.0f / (constant + linear * dist + quadratic * (dist * dist));
 
     vec3 reflectDir = reflect(-lightDirN, fNormal);
-    vec3 viewDir = normalize(- fragPosEye.xyz);
+    vec3 viewDir = normalize(- fPosEye);
     float specCoeff = pow(max(dot(viewDir, reflectDir), 0.0f), 32);
 
     // combine results
@@ -107,45 +130,47 @@ vec3 computePointLight()
 
     return (ambient + diffuse + specular);
 }
+#endif
 
 float computeFog()
 {
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
     float fogDensity = 0.1f;
-    float fragmentDistance = length(fPosEye);
+    float fragmentDistance = length(vec4(fPosEye, 1.0f));
     float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
     return fogFactor;
 }
 
+#ifdef REFLECTION
 vec3 computeSkyboxColor()
 {
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 viewDir = normalize(-fPosEye.xyz);
+    vec3 viewDir = normalize(-fPosEye);
     vec3 I = normalize(-viewDir);
     vec3 R = reflect(I, normalize(fNormal));
     return vec3(texture(skybox, R).rgb);
 }
+#endif
 
 void main() 
 {
-    vec3 skyColor = computeSkyboxColor();
     float shadow = computeShadow();
 
     vec3 color = computeDirLight(shadow);
-    if(lightOn)
-        color += computePointLight();
+#ifdef POINT_LIGHT
+    color += computePointLight();
+#endif
 
-    if(refl)
-        color = mix(skyColor, color, 0.95f);
+#ifdef REFLECTION
+    color = mix(computeSkyboxColor(), color, 0.95f);
+#endif
 
     float fogFactor = computeFog();
     vec3 fogColor = 0.5f * lightColor;
     
-    float a;
-    if(transparent)
-        a = 0.2f;
-    else
-        a = 1.0f;
+#ifdef TRANSPARENT
+    float a = 0.2f;
+#else
+    float a = 1.0f;
+#endif
 
     fColor = vec4(mix(fogColor, color ,fogFactor), a);
 }
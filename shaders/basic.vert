@@ -5,21 +5,47 @@ layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
 out vec3 fPosition;
+out vec3 fPosEye;
 out vec3 fNormal;
 out vec2 fTexCoords;
-out vec4 fragPosLightSpace;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform	mat3 normalMatrix;
-uniform mat4 lightSpaceTrMatrix;
+//per-frame camera and light data, shared by every program (FrameUniforms in main.cpp)
+layout(std140) uniform FrameBlock
+{
+	mat4 view;
+	mat4 projection;
+	mat3 normalMatrix;
+	vec3 lightDir;
+	vec3 lightColor;
+	vec3 pointLightPos;
+	//cascaded shadow maps, nearest cascade first
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;
+	vec4 cascadeBias;
+	int cascadeCount;
+};
+
+//the object being drawn (ObjectUniforms in main.cpp)
+layout(std140) uniform ObjectBlock
+{
+	mat4 model;
+	//inverse transpose of the model matrix, computed on the CPU
+	mat3 modelNormalMatrix;
+};
+
+//dequantization of the 16-bit positions (mesh bounding box)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+//computed exactly like depthPrepass.vert, for the EQUAL depth test after the pre-pass
+invariant gl_Position;
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vec3(model * vec4(vPosition, 1.0));
-	fNormal = mat3(transpose(inverse(model))) * vNormal;
+	vec3 position = positionOffset + positionScale * vPosition;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+	fPosition = vec3(model * vec4(position, 1.0));
+	fPosEye = vec3(view * vec4(fPosition, 1.0));
+	fNormal = modelNormalMatrix * vNormal;
 	fTexCoords = vTexCoords;
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
 }
@@ -0,0 +1,57 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//per-instance transform, applied before the model matrix - rotation, translation and
+//uniform scale only, so its upper 3x3 can carry the normals
+layout(location=3) in mat4 instanceModel;
+
+out vec3 fPosition;
+out vec3 fPosEye;
+out vec3 fNormal;
+out vec2 fTexCoords;
+
+//per-frame camera and light data, shared by every program (FrameUniforms in main.cpp)
+layout(std140) uniform FrameBlock
+{
+	mat4 view;
+	mat4 projection;
+	mat3 normalMatrix;
+	vec3 lightDir;
+	vec3 lightColor;
+	vec3 pointLightPos;
+	//cascaded shadow maps, nearest cascade first
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;
+	vec4 cascadeBias;
+	int cascadeCount;
+};
+
+//the object being drawn (ObjectUniforms in main.cpp)
+layout(std140) uniform ObjectBlock
+{
+	mat4 model;
+	//inverse transpose of the model matrix, computed on the CPU
+	mat3 modelNormalMatrix;
+};
+
+//dequantization of the 16-bit positions (mesh bounding box)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+//computed exactly like depthPrepassInstanced.vert, for the EQUAL depth test after the pre-pass
+invariant gl_Position;
+
+void main() 
+{
+	mat4 instanceToWorld = model * instanceModel;
+	vec3 position = positionOffset + positionScale * vPosition;
+	gl_Position = projection * view * instanceToWorld * vec4(position, 1.0f);
+	fPosition = vec3(instanceToWorld * vec4(position, 1.0));
+	fPosEye = vec3(view * vec4(fPosition, 1.0));
+	//a uniformly scaled rotation is its own inverse transpose up to scale, which the
+	//fragment shader normalizes away
+	fNormal = modelNormalMatrix * mat3(instanceModel) * vNormal;
+	fTexCoords = vTexCoords;
+}
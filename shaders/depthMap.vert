@@ -2,11 +2,22 @@
 
 layout(location=0) in vec3 vPosition;
 
+//light (or camera, for the occlusion boxes) transform of the pass
 uniform mat4 lightSpaceTrMatrix;
-uniform mat4 model;
+//the object being drawn (ObjectUniforms in main.cpp)
+layout(std140) uniform ObjectBlock
+{
+ mat4 model;
+ //inverse transpose of the model matrix, computed on the CPU
+ mat3 modelNormalMatrix;
+};
+//dequantization of the 16-bit positions (mesh bounding box)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main()
 {
- gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+ vec3 position = positionOffset + positionScale * vPosition;
+ gl_Position = lightSpaceTrMatrix * model * vec4(position, 1.0f);
 }
 
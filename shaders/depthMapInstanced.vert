@@ -0,0 +1,23 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+//per-instance transform, applied before the model matrix (see basicInstanced.vert)
+layout(location=3) in mat4 instanceModel;
+
+uniform mat4 lightSpaceTrMatrix;
+//the object being drawn (ObjectUniforms in main.cpp)
+layout(std140) uniform ObjectBlock
+{
+ mat4 model;
+ //inverse transpose of the model matrix, computed on the CPU
+ mat3 modelNormalMatrix;
+};
+//dequantization of the 16-bit positions (mesh bounding box)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+ vec3 position = positionOffset + positionScale * vPosition;
+ gl_Position = lightSpaceTrMatrix * model * instanceModel * vec4(position, 1.0f);
+}
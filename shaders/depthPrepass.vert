@@ -0,0 +1,40 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+//per-frame camera and light data, shared by every program (FrameUniforms in main.cpp)
+layout(std140) uniform FrameBlock
+{
+	mat4 view;
+	mat4 projection;
+	mat3 normalMatrix;
+	vec3 lightDir;
+	vec3 lightColor;
+	vec3 pointLightPos;
+	//cascaded shadow maps, nearest cascade first
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;
+	vec4 cascadeBias;
+	int cascadeCount;
+};
+
+//the object being drawn (ObjectUniforms in main.cpp)
+layout(std140) uniform ObjectBlock
+{
+	mat4 model;
+	//inverse transpose of the model matrix, computed on the CPU
+	mat3 modelNormalMatrix;
+};
+
+//dequantization of the 16-bit positions (mesh bounding box)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+//must match basic.vert bit for bit, the shading pass tests its depth with EQUAL
+invariant gl_Position;
+
+void main()
+{
+	vec3 position = positionOffset + positionScale * vPosition;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+}
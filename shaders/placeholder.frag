@@ -0,0 +1,29 @@
+#version 410 core
+
+//flat grey with the directional light, drawn while the basic shaders are still compiling
+
+in vec3 fNormal;
+
+out vec4 fColor;
+
+//per-frame camera and light data, shared by every program (FrameUniforms in main.cpp)
+layout(std140) uniform FrameBlock
+{
+	mat4 view;
+	mat4 projection;
+	mat3 normalMatrix;
+	vec3 lightDir;
+	vec3 lightColor;
+	vec3 pointLightPos;
+	//cascaded shadow maps, nearest cascade first
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;
+	vec4 cascadeBias;
+	int cascadeCount;
+};
+
+void main()
+{
+	float diffuse = max(dot(normalize(fNormal), normalize(lightDir)), 0.0f);
+	fColor = vec4((0.2f + 0.6f * diffuse) * lightColor, 1.0f);
+}
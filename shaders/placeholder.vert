@@ -0,0 +1,44 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+
+out vec3 fNormal;
+
+//per-frame camera and light data, shared by every program (FrameUniforms in main.cpp)
+layout(std140) uniform FrameBlock
+{
+	mat4 view;
+	mat4 projection;
+	mat3 normalMatrix;
+	vec3 lightDir;
+	vec3 lightColor;
+	vec3 pointLightPos;
+	//cascaded shadow maps, nearest cascade first
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;
+	vec4 cascadeBias;
+	int cascadeCount;
+};
+
+//the object being drawn (ObjectUniforms in main.cpp)
+layout(std140) uniform ObjectBlock
+{
+	mat4 model;
+	//inverse transpose of the model matrix, computed on the CPU
+	mat3 modelNormalMatrix;
+};
+
+//dequantization of the 16-bit positions (mesh bounding box)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+//stands in for basic.vert, so it has to pass the same EQUAL test after the pre-pass
+invariant gl_Position;
+
+void main()
+{
+	vec3 position = positionOffset + positionScale * vPosition;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+	fNormal = modelNormalMatrix * vNormal;
+}
@@ -0,0 +1,15 @@
+#version 410 core
+
+//static cache of the cascade (ShadowCascades), on the same texel grid as the cascade
+uniform sampler2D staticDepth;
+//static texel under the first texel of the cascade
+uniform vec2 staticTexelOffset;
+//cascade depth = static depth * x + y, the boxes only differ in their near and far planes
+uniform vec2 staticDepthRemap;
+
+void main()
+{
+	float depth = texelFetch(staticDepth, ivec2(gl_FragCoord.xy) + ivec2(staticTexelOffset), 0).r;
+	//nothing was drawn there - keep the cleared far plane
+	gl_FragDepth = depth >= 1.0 ? 1.0 : clamp(depth * staticDepthRemap.x + staticDepthRemap.y, 0.0, 1.0);
+}
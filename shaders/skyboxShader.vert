@@ -1,15 +1,16 @@
 #version 410 core
 
-layout (location = 0) in vec3 vertexPosition;
 out vec3 textureCoordinates;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+//inverse of projection * view, without the view translation
+uniform mat4 inverseViewProjection;
 
 void main()
 {
-    vec4 tempPos = projection * view * vec4(vertexPosition, 1.0);
-    gl_Position = tempPos.xyww;
-    textureCoordinates = vertexPosition;
+    //one triangle covering the screen, made from the vertex index - no vertex buffer
+    vec2 position = vec2(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0);
+    //on the far plane, so it only shows where nothing else was drawn
+    gl_Position = vec4(position, 1.0, 1.0);
+    vec4 direction = inverseViewProjection * vec4(position, 1.0, 1.0);
+    textureCoordinates = direction.xyz / direction.w;
 }